@@ -0,0 +1,410 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * mc-extract: copy one player's sessions out of a (large) pcap.
+ *
+ *   mc-extract [-p port] <username> <in.pcap> <out.pcap>
+ *
+ * The capture is read in a single sequential pass through mmap.  For every
+ * new TCP flow to the server port only the first few hundred bytes the
+ * client sends are looked at: the Handshake (0x02) and Login (0x01)
+ * usernames decide whether the flow belongs to the player.  Until that
+ * decision the flow's packets are remembered by file offset only; after
+ * it they are either written out or skipped without looking at them
+ * again, until the connection closes or a new one reuses its ports.
+ * Memory use is bounded by the flow table, not the capture size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mc-pcap.h"
+
+#define MC_PORT          25565
+
+#define FLOW_TABLE_SIZE  (1 << 18)
+#define MAX_LOGIN_BYTES  512   /* client bytes looked at before giving up */
+#define MAX_PENDING      64    /* packets remembered before a decision */
+
+enum { FLOW_FREE, FLOW_UNKNOWN, FLOW_MATCH, FLOW_NOMATCH, FLOW_CLOSED };
+enum { LOGIN_NEED_MORE, LOGIN_MATCH, LOGIN_NOMATCH };
+
+typedef struct {
+    uint8_t addr_len;
+    uint8_t pad;        /* keeps the key free of compiler padding */
+    uint8_t client_addr[16];
+    uint8_t server_addr[16];
+    uint16_t client_port;
+    uint16_t server_port;
+} flow_key_t;
+
+/* State kept only while we still don't know who a flow belongs to */
+typedef struct {
+    int have_seq;
+    uint32_t next_seq;
+    uint16_t buf_len;
+    uint8_t buf[MAX_LOGIN_BYTES];
+    uint16_t npending;
+    uint64_t pending[MAX_PENDING];
+} flow_login_t;
+
+typedef struct {
+    uint8_t state;
+    uint8_t fin;        /* FINs seen on a matched flow, 1 client 2 server */
+    flow_key_t key;
+    flow_login_t *login;
+} flow_t;
+
+typedef struct {
+    mc_pcap_t pcap;
+    FILE *out;
+    const char *name;
+    size_t name_len;
+    uint16_t port;
+    flow_t *flows;
+    uint32_t nflows;
+    uint64_t packets;
+    uint64_t written;
+    uint64_t matched;
+} extract_t;
+
+static uint32_t hash_key(const flow_key_t *key)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < sizeof(*key); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Slot holding key in table, or the free slot it would go in */
+static flow_t *flow_slot(flow_t *table, const flow_key_t *key)
+{
+    uint32_t i = hash_key(key) & (FLOW_TABLE_SIZE - 1);
+
+    while (table[i].state != FLOW_FREE && memcmp(&table[i].key, key, sizeof(*key))) {
+        i = (i + 1) & (FLOW_TABLE_SIZE - 1);
+    }
+    return &table[i];
+}
+
+/*
+ * Drop flows we no longer need to remember.  Flows that were already
+ * rejected or have closed are forgotten first; if they come back their
+ * data won't start with a Handshake and they are rejected again straight
+ * away.
+ * Only if that does not free enough room are undecided flows dropped.
+ */
+static void purge_flows(extract_t *ex)
+{
+    flow_t *old = ex->flows;
+    uint32_t i, keep_unknown;
+
+    for (keep_unknown = 1; ; keep_unknown = 0) {
+        ex->flows = calloc(FLOW_TABLE_SIZE, sizeof(flow_t));
+        ex->nflows = 0;
+        for (i = 0; i < FLOW_TABLE_SIZE; i++) {
+            if (old[i].state == FLOW_MATCH || (keep_unknown && old[i].state == FLOW_UNKNOWN)) {
+                *flow_slot(ex->flows, &old[i].key) = old[i];
+                ex->nflows++;
+            }
+        }
+        if (!keep_unknown || ex->nflows < FLOW_TABLE_SIZE / 2) {
+            break;
+        }
+        free(ex->flows);
+    }
+    for (i = 0; i < FLOW_TABLE_SIZE; i++) {
+        if (old[i].state == FLOW_UNKNOWN && !keep_unknown) {
+            free(old[i].login);
+        }
+    }
+    free(old);
+}
+
+static flow_t *find_flow(extract_t *ex, const flow_key_t *key)
+{
+    flow_t *flow = flow_slot(ex->flows, key);
+
+    if (flow->state != FLOW_FREE) {
+        return flow;
+    }
+    if (ex->nflows >= FLOW_TABLE_SIZE * 3 / 4) {
+        purge_flows(ex);
+        flow = flow_slot(ex->flows, key);
+    }
+    ex->nflows++;
+    flow->key = *key;
+    flow->state = FLOW_UNKNOWN;
+    flow->fin = 0;
+    flow->login = NULL;
+    return flow;
+}
+
+/* Handshake usernames may carry ";host:port" after the name */
+static int name_matches(const extract_t *ex, const uint8_t *s, size_t len)
+{
+    if (len < ex->name_len || memcmp(s, ex->name, ex->name_len)) {
+        return 0;
+    }
+    return len == ex->name_len || s[ex->name_len] == ';';
+}
+
+/* Walk the start of the client stream looking at Handshake and Login */
+static int check_login(const extract_t *ex, const uint8_t *buf, size_t len)
+{
+    size_t off = 0, slen;
+
+    while (off < len) {
+        switch (buf[off]) {
+        case 0x00:
+            off += 1;
+            break;
+        case 0x02:
+            if (len - off < 3) {
+                return LOGIN_NEED_MORE;
+            }
+            slen = mc_get16(buf + off + 1);
+            if (len - off < 3 + slen) {
+                return LOGIN_NEED_MORE;
+            }
+            if (name_matches(ex, buf + off + 3, slen)) {
+                return LOGIN_MATCH;
+            }
+            off += 3 + slen;
+            break;
+        case 0x01:
+            if (len - off < 7) {
+                return LOGIN_NEED_MORE;
+            }
+            slen = mc_get16(buf + off + 5);
+            if (len - off < 7 + slen) {
+                return LOGIN_NEED_MORE;
+            }
+            return name_matches(ex, buf + off + 7, slen) ? LOGIN_MATCH : LOGIN_NOMATCH;
+        default:
+            return LOGIN_NOMATCH;
+        }
+    }
+    return LOGIN_NEED_MORE;
+}
+
+static void write_record(extract_t *ex, uint64_t off)
+{
+    mc_pcap_copy_record(&ex->pcap, off, ex->out);
+    ex->written++;
+}
+
+static void decide(extract_t *ex, flow_t *flow, int match)
+{
+    flow_login_t *login = flow->login;
+    uint16_t i;
+
+    if (match) {
+        for (i = 0; i < login->npending; i++) {
+            write_record(ex, login->pending[i]);
+        }
+        ex->matched++;
+    }
+    free(login);
+    flow->login = NULL;
+    flow->state = match ? FLOW_MATCH : FLOW_NOMATCH;
+}
+
+static void handle_packet(extract_t *ex, const mc_pcap_rec_t *rec)
+{
+    mc_tcp_t tcp;
+    uint32_t off, plen;
+    int from_client;
+    flow_key_t key;
+    flow_t *flow;
+    flow_login_t *login;
+
+    if (!mc_pcap_tcp(&ex->pcap, rec, &tcp)) {
+        return;
+    }
+    if (tcp.dport == ex->port) {
+        from_client = 1;
+    } else if (tcp.sport == ex->port) {
+        from_client = 0;
+    } else {
+        return;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.addr_len = tcp.addr_len;
+    memcpy(key.client_addr, from_client ? tcp.src : tcp.dst, tcp.addr_len);
+    memcpy(key.server_addr, from_client ? tcp.dst : tcp.src, tcp.addr_len);
+    key.client_port = from_client ? tcp.sport : tcp.dport;
+    key.server_port = ex->port;
+
+    flow = find_flow(ex, &key);
+    if (flow->state != FLOW_UNKNOWN && from_client && (tcp.flags & MC_TCP_SYN)) {
+        /* a new connection reusing the same ports gets another look */
+        flow->state = FLOW_UNKNOWN;
+        flow->fin = 0;
+    }
+    if (flow->state == FLOW_MATCH) {
+        write_record(ex, rec->off);
+        if ((tcp.flags & MC_TCP_RST) || flow->fin == 3) {
+            /* reset, or the ACK of the second FIN: the connection is over */
+            flow->state = FLOW_CLOSED;
+        } else if (tcp.flags & MC_TCP_FIN) {
+            flow->fin |= from_client ? 1 : 2;
+        }
+        return;
+    }
+    if (flow->state != FLOW_UNKNOWN) {
+        return;
+    }
+
+    if (flow->login == NULL) {
+        flow->login = calloc(1, sizeof(flow_login_t));
+    }
+    login = flow->login;
+    if (login->npending == MAX_PENDING) {
+        decide(ex, flow, 0);
+        return;
+    }
+    login->pending[login->npending++] = rec->off;
+    if ((tcp.flags & (MC_TCP_FIN | MC_TCP_RST)) && tcp.payload_len == 0) {
+        /* closed before we saw who it was */
+        decide(ex, flow, 0);
+        return;
+    }
+    if (!from_client) {
+        return;
+    }
+
+    if (tcp.flags & MC_TCP_SYN) {
+        login->have_seq = 1;
+        login->next_seq = tcp.seq + 1;
+        return;
+    }
+    plen = tcp.payload_len;
+    if (plen == 0) {
+        return;
+    }
+    if (!login->have_seq) {
+        login->have_seq = 1;
+        login->next_seq = tcp.seq;
+    }
+
+    /* Only in-order client data is used, retransmissions fill the gaps */
+    if ((int32_t)(tcp.seq - login->next_seq) > 0) {
+        return;
+    }
+    if ((uint32_t)(login->next_seq - tcp.seq) >= plen) {
+        return;
+    }
+    off = login->next_seq - tcp.seq;
+    plen -= off;
+    if (plen > (uint32_t)(MAX_LOGIN_BYTES - login->buf_len)) {
+        plen = MAX_LOGIN_BYTES - login->buf_len;
+    }
+    memcpy(login->buf + login->buf_len, tcp.payload + off, plen);
+    login->buf_len += plen;
+    login->next_seq += plen;
+
+    switch (check_login(ex, login->buf, login->buf_len)) {
+    case LOGIN_MATCH:
+        decide(ex, flow, 1);
+        break;
+    case LOGIN_NOMATCH:
+        decide(ex, flow, 0);
+        break;
+    default:
+        if (login->buf_len == MAX_LOGIN_BYTES) {
+            decide(ex, flow, 0);
+        }
+        break;
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mc-extract [-p port] <username> <in.pcap> <out.pcap>\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    extract_t ex;
+    mc_pcap_rec_t rec;
+    int c;
+
+    memset(&ex, 0, sizeof(ex));
+    ex.port = MC_PORT;
+    while ((c = getopt(argc, argv, "p:")) != -1) {
+        switch (c) {
+        case 'p':
+            ex.port = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind != 3) {
+        usage();
+    }
+    ex.name = argv[optind];
+    ex.name_len = strlen(ex.name);
+
+    if (mc_pcap_open(&ex.pcap, argv[optind + 1]) < 0) {
+        return 1;
+    }
+    ex.out = fopen(argv[optind + 2], "wb");
+    if (ex.out == NULL) {
+        perror(argv[optind + 2]);
+        return 1;
+    }
+    setvbuf(ex.out, NULL, _IOFBF, 1 << 20);
+    mc_pcap_copy_header(&ex.pcap, ex.out);
+
+    ex.flows = calloc(FLOW_TABLE_SIZE, sizeof(flow_t));
+
+    while (mc_pcap_next(&ex.pcap, &rec)) {
+        handle_packet(&ex, &rec);
+        ex.packets++;
+    }
+
+    for (c = 0; c < FLOW_TABLE_SIZE; c++) {
+        free(ex.flows[c].login);
+    }
+    free(ex.flows);
+    mc_pcap_close(&ex.pcap);
+
+    if (fclose(ex.out) != 0) {
+        perror(argv[optind + 2]);
+        return 1;
+    }
+    fprintf(stderr, "%llu packets read, %llu sessions matched, %llu packets written\n",
+            (unsigned long long)ex.packets, (unsigned long long)ex.matched,
+            (unsigned long long)ex.written);
+    return 0;
+}
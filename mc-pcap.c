@@ -0,0 +1,298 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mc-pcap.h"
+
+#define DROP_BEHIND (64 << 20)
+
+uint16_t mc_get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+uint32_t mc_get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint32_t rd32(const mc_pcap_t *p, const uint8_t *d)
+{
+    uint32_t v;
+
+    memcpy(&v, d, 4);
+    return p->swapped ? __builtin_bswap32(v) : v;
+}
+
+int mc_pcap_open(mc_pcap_t *p, const char *path)
+{
+    struct stat st;
+    uint32_t magic;
+
+    memset(p, 0, sizeof(*p));
+    p->fd = open(path, O_RDONLY);
+    if (p->fd < 0 || fstat(p->fd, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    p->size = st.st_size;
+    if (p->size < MC_PCAP_HDR_LEN) {
+        fprintf(stderr, "%s: not a pcap file\n", path);
+        close(p->fd);
+        return -1;
+    }
+    p->map = mmap(NULL, p->size, PROT_READ, MAP_SHARED, p->fd, 0);
+    if (p->map == MAP_FAILED) {
+        perror("mmap");
+        close(p->fd);
+        return -1;
+    }
+    madvise((void *)p->map, p->size, MADV_SEQUENTIAL);
+
+    memcpy(&magic, p->map, 4);
+    if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+        p->swapped = 0;
+    } else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+        p->swapped = 1;
+    } else {
+        fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", path);
+        mc_pcap_close(p);
+        return -1;
+    }
+    p->nsec = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+    p->linktype = rd32(p, p->map + 20);
+    p->off = MC_PCAP_HDR_LEN;
+    return 0;
+}
+
+int mc_pcap_next(mc_pcap_t *p, mc_pcap_rec_t *rec)
+{
+    uint32_t caplen, frac;
+    uint64_t drop;
+
+    if (p->off + MC_PCAP_REC_LEN > p->size) {
+        return 0;
+    }
+    caplen = rd32(p, p->map + p->off + 8);
+    if (p->off + MC_PCAP_REC_LEN + caplen > p->size) {
+        fprintf(stderr, "warning: capture is truncated\n");
+        return 0;
+    }
+    frac = rd32(p, p->map + p->off + 4);
+    rec->off = p->off;
+    rec->ts_us = (uint64_t)rd32(p, p->map + p->off) * 1000000 + (p->nsec ? frac / 1000 : frac);
+    rec->data = p->map + p->off + MC_PCAP_REC_LEN;
+    rec->caplen = caplen;
+    p->off += MC_PCAP_REC_LEN + caplen;
+
+    /*
+     * Pages well behind the cursor are unmapped to keep our RSS down and
+     * evicted from the page cache so a huge capture doesn't push everything
+     * else out of it; on a shared file mapping madvise only does the first.
+     */
+    if (p->off - p->dropped > 2 * DROP_BEHIND) {
+        drop = (p->off - DROP_BEHIND) & ~(uint64_t)(getpagesize() - 1);
+        madvise((void *)(p->map + p->dropped), drop - p->dropped, MADV_DONTNEED);
+        posix_fadvise(p->fd, p->dropped, drop - p->dropped, POSIX_FADV_DONTNEED);
+        p->dropped = drop;
+    }
+    return 1;
+}
+
+void mc_pcap_close(mc_pcap_t *p)
+{
+    munmap((void *)p->map, p->size);
+    close(p->fd);
+}
+
+/* Returns the offset of the IP header within the frame, or -1 */
+static int ip_offset(const mc_pcap_t *p, const uint8_t *pkt, uint32_t caplen, int *version)
+{
+    uint16_t ethertype;
+    int off;
+
+    switch (p->linktype) {
+    case 0:     /* DLT_NULL */
+        if (caplen < 5) {
+            return -1;
+        }
+        *version = pkt[4] >> 4;
+        return 4;
+    case 1:     /* DLT_EN10MB */
+        off = 12;
+        do {
+            if (caplen < (uint32_t)off + 2) {
+                return -1;
+            }
+            ethertype = mc_get16(pkt + off);
+            off += 2;
+            if (ethertype == 0x8100 || ethertype == 0x88a8) {
+                off += 2;
+            }
+        } while (ethertype == 0x8100 || ethertype == 0x88a8);
+        break;
+    case 113:   /* DLT_LINUX_SLL */
+        if (caplen < 16) {
+            return -1;
+        }
+        ethertype = mc_get16(pkt + 14);
+        off = 16;
+        break;
+    case 12:
+    case 14:
+    case 101:   /* DLT_RAW */
+        if (caplen < 1) {
+            return -1;
+        }
+        *version = pkt[0] >> 4;
+        return 0;
+    default:
+        return -1;
+    }
+    if (ethertype == 0x0800) {
+        *version = 4;
+    } else if (ethertype == 0x86dd) {
+        *version = 6;
+    } else {
+        return -1;
+    }
+    return off;
+}
+
+/* Fills in tcp and returns 1 if the record is an unfragmented TCP segment */
+int mc_pcap_tcp(const mc_pcap_t *p, const mc_pcap_rec_t *rec, mc_tcp_t *tcp)
+{
+    const uint8_t *pkt = rec->data, *th;
+    uint32_t rem, plen, thl;
+    int off, version = 0;
+
+    off = ip_offset(p, pkt, rec->caplen, &version);
+    if (off < 0) {
+        return 0;
+    }
+    pkt += off;
+    rem = rec->caplen - off;
+
+    if (version == 4) {
+        uint32_t ihl;
+
+        /*
+         * Fragments are skipped, the first one too (more fragments set,
+         * offset 0): its TCP header is there but the payload is cut short.
+         */
+        if (rem < 20 || pkt[9] != 6 || (mc_get16(pkt + 6) & 0x3fff)) {
+            return 0;
+        }
+        ihl = (pkt[0] & 0x0f) * 4;
+        plen = mc_get16(pkt + 2);
+        if (ihl < 20 || plen < ihl || rem < ihl) {
+            return 0;
+        }
+        tcp->src = pkt + 12;
+        tcp->dst = pkt + 16;
+        tcp->addr_len = 4;
+        th = pkt + ihl;
+        rem = (plen < rem ? plen : rem) - ihl;
+    } else if (version == 6) {
+        if (rem < 40 || pkt[6] != 6) {
+            return 0;
+        }
+        plen = mc_get16(pkt + 4);
+        tcp->src = pkt + 8;
+        tcp->dst = pkt + 24;
+        tcp->addr_len = 16;
+        th = pkt + 40;
+        rem = (plen < rem - 40 ? plen : rem - 40);
+    } else {
+        return 0;
+    }
+
+    if (rem < 20) {
+        return 0;
+    }
+    thl = (th[12] >> 4) * 4;
+    if (thl < 20 || thl > rem) {
+        return 0;
+    }
+    tcp->sport = mc_get16(th);
+    tcp->dport = mc_get16(th + 2);
+    tcp->seq = mc_get32(th + 4);
+    tcp->flags = th[13];
+    tcp->payload = th + thl;
+    tcp->payload_len = rem - thl;
+    return 1;
+}
+
+void mc_pcap_copy_header(const mc_pcap_t *p, FILE *out)
+{
+    fwrite(p->map, 1, MC_PCAP_HDR_LEN, out);
+}
+
+void mc_pcap_copy_record(const mc_pcap_t *p, uint64_t off, FILE *out)
+{
+    fwrite(p->map + off, 1, MC_PCAP_REC_LEN + rd32(p, p->map + off + 8), out);
+}
+
+static void put_le32(uint8_t *d, uint32_t v)
+{
+    d[0] = v;
+    d[1] = v >> 8;
+    d[2] = v >> 16;
+    d[3] = v >> 24;
+}
+
+void mc_pcap_write_header(FILE *out, uint32_t linktype)
+{
+    uint8_t hdr[MC_PCAP_HDR_LEN];
+
+    put_le32(hdr, 0xa1b2c3d4);
+    hdr[4] = 2;
+    hdr[5] = 0;
+    hdr[6] = 4;
+    hdr[7] = 0;
+    put_le32(hdr + 8, 0);
+    put_le32(hdr + 12, 0);
+    put_le32(hdr + 16, 65535);
+    put_le32(hdr + 20, linktype);
+    fwrite(hdr, 1, sizeof(hdr), out);
+}
+
+void mc_pcap_write_record(FILE *out, uint64_t ts_us, const uint8_t *data, uint32_t len)
+{
+    uint8_t hdr[MC_PCAP_REC_LEN];
+
+    put_le32(hdr, ts_us / 1000000);
+    put_le32(hdr + 4, ts_us % 1000000);
+    put_le32(hdr + 8, len);
+    put_le32(hdr + 12, len);
+    fwrite(hdr, 1, sizeof(hdr), out);
+    fwrite(data, 1, len, out);
+}
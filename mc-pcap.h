@@ -0,0 +1,87 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * Minimal pcap reading and writing shared by the standalone tools.  The
+ * input is mmapped and walked sequentially; pages behind the cursor are
+ * unmapped and evicted from the page cache as we go, so huge captures
+ * neither grow our RSS nor fill the page cache.
+ */
+
+#ifndef __MC_PCAP_H__
+#define __MC_PCAP_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define MC_PCAP_HDR_LEN 24
+#define MC_PCAP_REC_LEN 16
+
+typedef struct {
+    int fd;
+    const uint8_t *map;
+    uint64_t size;
+    int swapped;
+    int nsec;
+    uint32_t linktype;
+    uint64_t off;
+    uint64_t dropped;
+} mc_pcap_t;
+
+typedef struct {
+    uint64_t off;           /* of the record header in the file */
+    uint64_t ts_us;
+    const uint8_t *data;
+    uint32_t caplen;
+} mc_pcap_rec_t;
+
+typedef struct {
+    int addr_len;           /* 4 or 16 */
+    const uint8_t *src;
+    const uint8_t *dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t seq;
+    uint8_t flags;
+    const uint8_t *payload;
+    uint32_t payload_len;
+} mc_tcp_t;
+
+#define MC_TCP_FIN 0x01
+#define MC_TCP_SYN 0x02
+#define MC_TCP_RST 0x04
+
+int mc_pcap_open(mc_pcap_t *p, const char *path);
+int mc_pcap_next(mc_pcap_t *p, mc_pcap_rec_t *rec);
+void mc_pcap_close(mc_pcap_t *p);
+
+int mc_pcap_tcp(const mc_pcap_t *p, const mc_pcap_rec_t *rec, mc_tcp_t *tcp);
+
+void mc_pcap_copy_header(const mc_pcap_t *p, FILE *out);
+void mc_pcap_copy_record(const mc_pcap_t *p, uint64_t off, FILE *out);
+
+void mc_pcap_write_header(FILE *out, uint32_t linktype);
+void mc_pcap_write_record(FILE *out, uint64_t ts_us, const uint8_t *data, uint32_t len);
+
+uint16_t mc_get16(const uint8_t *p);
+uint32_t mc_get32(const uint8_t *p);
+
+#endif
@@ -0,0 +1,1411 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * mc-record: compact long term storage for Minecraft traffic.
+ *
+ *   mc-record pack [-p port] <in.pcap> <out.mcr>
+ *   mc-record unpack [-s start] [-e end] <in.mcr> <out.pcap>
+ *   mc-record info <in.mcr>
+ *
+ * pack reassembles every conversation to the server port, splits the
+ * streams into PDUs and stores them without any of the link, IP or TCP
+ * framing.  unpack turns a recording back into a pcap with one TCP stream
+ * per conversation carrying the very same PDU bytes, so the dissector
+ * decodes it exactly as it did the original capture.  -s and -e (seconds
+ * since the epoch) use the time index to only decode the blocks needed.
+ *
+ * File layout, all fixed width integers little endian:
+ *
+ *   "MCR2" u32 server_port
+ *   blocks:  "MCRB" u32 raw_len u32 comp_len  zlib(records)
+ *   index:   "MCRI"
+ *            u32 nblocks, nblocks * (u64 offset, u64 min_us, u64 max_us, u32 records)
+ *            u32 nconvs,  nconvs * (u8 addr_len, client[16], server[16], u16 cport, u16 sport)
+ *            u32 nchunks, nchunks * (u32 block, u32 offset, u32 len)
+ *   trailer: u64 index_offset "MCRE"
+ *
+ * Every block is compressed on its own and all delta state is reset at
+ * the start of a block, so a block decodes without the ones before it,
+ * except that a CHUNK_REF needs the block holding its payload, which the
+ * index points at.  A record is
+ *
+ *   u8 kind | dir << 7, varint conversation, varint zigzag(time delta us)
+ *
+ * followed by a kind specific body:
+ *
+ *   RAW, STREAM      varint len, bytes.  STREAM is unframed stream data,
+ *                    used for whatever follows a gap we couldn't recover.
+ *   POS (0x0B)       4 varint doubles, u8 on ground
+ *   POS_LOOK (0x0D)  4 varint doubles, 2 varint floats, u8 on ground
+ *                    (doubles and floats are XORed with the previous value
+ *                    of the same field in the same direction)
+ *   MOVE (0x1F)      varint zigzag(entity id delta), u8 dx, dy, dz
+ *   LOOK (0x20)      varint zigzag(entity id delta), u8 yaw, u8 pitch
+ *   MOVE_LOOK (0x21) MOVE followed by u8 yaw, u8 pitch
+ *   CHUNK (0x33)     varint chunk id, 18 byte header, payload
+ *   CHUNK_REF        varint chunk id, 18 byte header
+ *
+ * The time is relative to the previous record in the block, or to 0 for
+ * the first one.  min_us and max_us in the index are the block's earliest
+ * and latest record times, which need not be its first and last ones.
+ *
+ * Map Chunk payloads are stored the first time they are seen and
+ * referenced by a 128 bit content hash afterwards; the index gives the
+ * block and offset each one lives at.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "mc-pcap.h"
+
+#define MC_PORT         25565
+
+#define MCR_BLOCK_SIZE  (1 << 20)   /* raw bytes per block before compression */
+#define MCR_MAX_PDU     (4 << 20)   /* anything longer is taken as garbage */
+#define MCR_MAX_OOO     (256 << 10) /* out of order bytes held per direction */
+#define MCR_MSS         1460        /* segment size used by unpack */
+#define MCR_CHUNK_HDR   18
+
+#define MCR_CONV_LEN    37
+#define MCR_BLOCK_LEN   28
+#define MCR_CHUNK_LEN   12
+
+enum {
+    REC_RAW,
+    REC_STREAM,
+    REC_POS,
+    REC_POS_LOOK,
+    REC_MOVE,
+    REC_LOOK,
+    REC_MOVE_LOOK,
+    REC_CHUNK,
+    REC_CHUNK_REF
+};
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} buf_t;
+
+/* Delta coding state of one direction, only valid within one block */
+typedef struct {
+    uint32_t block;         /* block number + 1, 0 means never used */
+    uint64_t pos[4];
+    uint32_t look[2];
+    int32_t eid;
+} delta_t;
+
+typedef struct _seg {
+    uint32_t seq;
+    uint32_t len;
+    uint64_t ts;
+    struct _seg *next;
+    uint8_t data[];
+} seg_t;
+
+typedef struct {
+    int have_seq;
+    int desync;
+    uint32_t next_seq;
+    buf_t buf;
+    seg_t *ooo;
+    size_t ooo_bytes;
+} stream_t;
+
+typedef struct {
+    uint8_t addr_len;
+    uint8_t client[16];
+    uint8_t server[16];
+    uint16_t client_port;
+    uint16_t server_port;
+    stream_t dir[2];        /* 0 client to server, 1 server to client */
+    delta_t delta[2];
+} conv_t;
+
+typedef struct {
+    uint64_t h1;
+    uint64_t h2;
+    uint32_t len;
+    uint32_t id;
+} chunk_hash_t;
+
+typedef struct {
+    FILE *out;
+    uint16_t port;
+    uint64_t file_off;
+
+    conv_t **convs;
+    uint32_t nconvs;
+    uint32_t *conv_slots;
+    uint32_t conv_slots_size;
+
+    buf_t raw;
+    uint32_t block;
+    uint32_t block_records;
+    uint64_t block_min_ts;
+    uint64_t block_max_ts;
+    uint64_t prev_ts;
+    buf_t index_blocks;
+
+    chunk_hash_t *chunk_slots;
+    uint32_t chunk_slots_size;
+    uint32_t nchunks;
+    buf_t index_chunks;
+
+    uint64_t pdus;
+    uint64_t dup_chunks;
+} writer_t;
+
+/* ---- buffers and encodings ---- */
+
+static void buf_reserve(buf_t *b, size_t n)
+{
+    if (b->len + n > b->cap) {
+        b->cap = (b->len + n) * 2;
+        b->data = realloc(b->data, b->cap);
+    }
+}
+
+static void buf_put(buf_t *b, const void *d, size_t n)
+{
+    buf_reserve(b, n);
+    memcpy(b->data + b->len, d, n);
+    b->len += n;
+}
+
+static void buf_put8(buf_t *b, uint8_t v)
+{
+    buf_put(b, &v, 1);
+}
+
+static void buf_le(buf_t *b, uint64_t v, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        buf_put8(b, v >> (8 * i));
+    }
+}
+
+static void buf_varint(buf_t *b, uint64_t v)
+{
+    while (v >= 0x80) {
+        buf_put8(b, (v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    buf_put8(b, v);
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint64_t get_be(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void put_be(uint8_t *p, uint64_t v, int n)
+{
+    int i;
+
+    for (i = n - 1; i >= 0; i--) {
+        p[i] = v;
+        v >>= 8;
+    }
+}
+
+static uint64_t get_le(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/* Bounds checked reader over a decoded block */
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    int bad;
+} cursor_t;
+
+static uint8_t cur_u8(cursor_t *c)
+{
+    if (c->p >= c->end) {
+        c->bad = 1;
+        return 0;
+    }
+    return *c->p++;
+}
+
+static uint64_t cur_varint(cursor_t *c)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+
+    do {
+        b = cur_u8(c);
+        if (shift < 64) {
+            v |= (uint64_t)(b & 0x7f) << shift;
+        }
+        shift += 7;
+    } while ((b & 0x80) && !c->bad);
+    return v;
+}
+
+static const uint8_t *cur_bytes(cursor_t *c, uint64_t n)
+{
+    const uint8_t *p = c->p;
+
+    if ((uint64_t)(c->end - c->p) < n) {
+        c->bad = 1;
+        return NULL;
+    }
+    c->p += n;
+    return p;
+}
+
+static uint64_t cur_le(cursor_t *c, int n)
+{
+    const uint8_t *p = cur_bytes(c, n);
+
+    return p ? get_le(p, n) : 0;
+}
+
+/* ---- PDU framing ---- */
+
+/*
+ * Length of the PDU at the start of buf, 0 if more data is needed to
+ * tell, -1 for an unknown type.  This follows get_minecraft_packet_len()
+ * in packet-minecraft.c.
+ */
+static int64_t pdu_len(const uint8_t *buf, size_t avail)
+{
+    size_t o, count, num;
+
+    switch (buf[0]) {
+    case 0x00:
+        return 1;
+    case 0x01:
+        if (avail < 7 || avail < 9 + (size_t)mc_get16(buf + 5)) {
+            return 0;
+        }
+        return 5 + (2 + mc_get16(buf + 5)) + (2 + mc_get16(buf + 7 + mc_get16(buf + 5))) + 9;
+    case 0x02:
+    case 0x03:
+    case 0xff:
+        return avail < 3 ? 0 : 3 + mc_get16(buf + 1);
+    case 0x04:
+        return 9;
+    case 0x05:
+        if (avail < 7) {
+            return 0;
+        }
+        num = mc_get16(buf + 5);
+        for (o = 7, count = 0; count != num; count++) {
+            if (avail < o + 2) {
+                return 0;
+            }
+            o += mc_get16(buf + o) == 0xffff ? 2 : 5;
+        }
+        return o;
+    case 0x06:
+        return 13;
+    case 0x0A:
+        return 2;
+    case 0x0B:
+        return 34;
+    case 0x07:
+        return 9;
+    case 0x0C:
+        return 10;
+    case 0x0D:
+        return 42;
+    case 0x0E:
+        return 12;
+    case 0x0F:
+        return 13;
+    case 0x10:
+        return 7;
+    case 0x11:
+    case 0x12:
+        return 6;
+    case 0x15:
+        return 23;
+    case 0x16:
+        return 9;
+    case 0x17:
+        return 18;
+    case 0x18:
+        return 20;
+    case 0x1C:
+        return 11;
+    case 0x1D:
+    case 0x1E:
+        return 5;
+    case 0x1F:
+        return 8;
+    case 0x20:
+        return 7;
+    case 0x21:
+        return 10;
+    case 0x22:
+        return 19;
+    case 0x27:
+        return 9;
+    case 0x32:
+        return 10;
+    case 0x33:
+        return avail < 18 ? 0 : 18 + (int64_t)mc_get32(buf + 14);
+    case 0x34:
+        return avail < 11 ? 0 : 11 + 4 * mc_get16(buf + 9);
+    case 0x35:
+        return 12;
+    case 0x3b:
+        return avail < 13 ? 0 : 13 + mc_get16(buf + 11);
+    }
+    return -1;
+}
+
+/* ---- writing ---- */
+
+static void chunk_hash(const uint8_t *d, size_t len, uint64_t *h1, uint64_t *h2)
+{
+    uint64_t a = 0xcbf29ce484222325ULL, b = 0x9e3779b97f4a7c15ULL ^ len;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        a = (a ^ d[i]) * 0x100000001b3ULL;
+        b = (b + d[i]) * 0xff51afd7ed558ccdULL;
+        b ^= b >> 29;
+    }
+    *h1 = a;
+    *h2 = b;
+}
+
+/*
+ * Look the payload up by content hash.  Returns its id and sets *is_new
+ * if it hasn't been seen before.
+ */
+static uint32_t chunk_id(writer_t *w, const uint8_t *d, uint32_t len, int *is_new)
+{
+    chunk_hash_t *slot;
+    uint64_t h1, h2;
+    uint32_t i;
+
+    if (w->nchunks * 2 >= w->chunk_slots_size) {
+        chunk_hash_t *old = w->chunk_slots;
+        uint32_t old_size = w->chunk_slots_size;
+
+        w->chunk_slots_size = old_size ? old_size * 2 : 1024;
+        w->chunk_slots = calloc(w->chunk_slots_size, sizeof(chunk_hash_t));
+        for (i = 0; i < old_size; i++) {
+            if (old[i].id) {
+                uint32_t j = old[i].h1 & (w->chunk_slots_size - 1);
+
+                while (w->chunk_slots[j].id) {
+                    j = (j + 1) & (w->chunk_slots_size - 1);
+                }
+                w->chunk_slots[j] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    chunk_hash(d, len, &h1, &h2);
+    i = h1 & (w->chunk_slots_size - 1);
+    for (slot = &w->chunk_slots[i]; slot->id; slot = &w->chunk_slots[i]) {
+        if (slot->h1 == h1 && slot->h2 == h2 && slot->len == len) {
+            *is_new = 0;
+            return slot->id - 1;
+        }
+        i = (i + 1) & (w->chunk_slots_size - 1);
+    }
+    slot->h1 = h1;
+    slot->h2 = h2;
+    slot->len = len;
+    slot->id = ++w->nchunks;
+    *is_new = 1;
+    return slot->id - 1;
+}
+
+static void flush_block(writer_t *w)
+{
+    buf_t hdr = { 0 };
+    uLongf comp_len;
+    uint8_t *comp;
+
+    if (w->block_records == 0) {
+        return;
+    }
+    comp_len = compressBound(w->raw.len);
+    comp = malloc(comp_len);
+    if (compress2(comp, &comp_len, w->raw.data, w->raw.len, 6) != Z_OK) {
+        fprintf(stderr, "compression failed\n");
+        exit(1);
+    }
+
+    buf_le(&w->index_blocks, w->file_off, 8);
+    buf_le(&w->index_blocks, w->block_min_ts, 8);
+    buf_le(&w->index_blocks, w->block_max_ts, 8);
+    buf_le(&w->index_blocks, w->block_records, 4);
+
+    buf_put(&hdr, "MCRB", 4);
+    buf_le(&hdr, w->raw.len, 4);
+    buf_le(&hdr, comp_len, 4);
+    fwrite(hdr.data, 1, hdr.len, w->out);
+    fwrite(comp, 1, comp_len, w->out);
+    w->file_off += hdr.len + comp_len;
+    free(hdr.data);
+    free(comp);
+
+    w->raw.len = 0;
+    w->block++;
+    w->block_records = 0;
+}
+
+static void begin_record(writer_t *w, int kind, int dir, uint32_t conv_id, uint64_t ts)
+{
+    if (w->raw.len >= MCR_BLOCK_SIZE) {
+        flush_block(w);
+    }
+    /* Out of order segments carry older times than the records around them. */
+    if (w->block_records++ == 0) {
+        w->block_min_ts = w->block_max_ts = ts;
+        w->prev_ts = 0;
+    } else if (ts < w->block_min_ts) {
+        w->block_min_ts = ts;
+    } else if (ts > w->block_max_ts) {
+        w->block_max_ts = ts;
+    }
+    buf_put8(&w->raw, kind | (dir << 7));
+    buf_varint(&w->raw, conv_id);
+    buf_varint(&w->raw, zigzag((int64_t)(ts - w->prev_ts)));
+    w->prev_ts = ts;
+}
+
+static void emit_stream(writer_t *w, uint32_t conv_id, int dir, const uint8_t *d, size_t len, uint64_t ts)
+{
+    if (len == 0) {
+        return;
+    }
+    begin_record(w, REC_STREAM, dir, conv_id, ts);
+    buf_varint(&w->raw, len);
+    buf_put(&w->raw, d, len);
+}
+
+static void emit_pdu(writer_t *w, uint32_t conv_id, conv_t *c, int dir, const uint8_t *pdu, size_t len, uint64_t ts)
+{
+    delta_t *delta = &c->delta[dir];
+    int i, is_new;
+    uint32_t id;
+    int32_t eid;
+
+    w->pdus++;
+    if (w->raw.len >= MCR_BLOCK_SIZE) {
+        flush_block(w);
+    }
+    if (delta->block != w->block + 1) {
+        memset(delta, 0, sizeof(*delta));
+        delta->block = w->block + 1;
+    }
+
+    switch (pdu[0]) {
+    case 0x0B:
+    case 0x0D:
+        begin_record(w, pdu[0] == 0x0B ? REC_POS : REC_POS_LOOK, dir, conv_id, ts);
+        for (i = 0; i < 4; i++) {
+            uint64_t v = get_be(pdu + 1 + 8 * i, 8);
+
+            buf_varint(&w->raw, v ^ delta->pos[i]);
+            delta->pos[i] = v;
+        }
+        if (pdu[0] == 0x0D) {
+            for (i = 0; i < 2; i++) {
+                uint32_t v = get_be(pdu + 33 + 4 * i, 4);
+
+                buf_varint(&w->raw, v ^ delta->look[i]);
+                delta->look[i] = v;
+            }
+        }
+        buf_put8(&w->raw, pdu[len - 1]);
+        return;
+    case 0x1F:
+    case 0x20:
+    case 0x21:
+        begin_record(w, pdu[0] == 0x1F ? REC_MOVE : pdu[0] == 0x20 ? REC_LOOK : REC_MOVE_LOOK, dir, conv_id, ts);
+        eid = get_be(pdu + 1, 4);
+        buf_varint(&w->raw, zigzag((int64_t)eid - delta->eid));
+        delta->eid = eid;
+        /*
+         * The moves are already deltas and fit a byte; delta coding them
+         * again against the entity's last move or varint coding them only
+         * made the blocks bigger, zlib does better on the bytes as sent.
+         */
+        buf_put(&w->raw, pdu + 5, len - 5);
+        return;
+    case 0x33:
+        id = chunk_id(w, pdu + MCR_CHUNK_HDR, len - MCR_CHUNK_HDR, &is_new);
+        begin_record(w, is_new ? REC_CHUNK : REC_CHUNK_REF, dir, conv_id, ts);
+        buf_varint(&w->raw, id);
+        buf_put(&w->raw, pdu, MCR_CHUNK_HDR);
+        if (is_new) {
+            buf_le(&w->index_chunks, w->block, 4);
+            buf_le(&w->index_chunks, w->raw.len, 4);
+            buf_le(&w->index_chunks, len - MCR_CHUNK_HDR, 4);
+            buf_put(&w->raw, pdu + MCR_CHUNK_HDR, len - MCR_CHUNK_HDR);
+        } else {
+            w->dup_chunks++;
+        }
+        return;
+    }
+
+    begin_record(w, REC_RAW, dir, conv_id, ts);
+    buf_varint(&w->raw, len);
+    buf_put(&w->raw, pdu, len);
+}
+
+/* Cut as many whole PDUs as possible off the front of the stream buffer */
+static void frame_pdus(writer_t *w, uint32_t conv_id, conv_t *c, int dir, uint64_t ts)
+{
+    stream_t *s = &c->dir[dir];
+    size_t off = 0;
+    int64_t len;
+
+    while (off < s->buf.len) {
+        len = pdu_len(s->buf.data + off, s->buf.len - off);
+        if (len == 0) {
+            break;
+        }
+        if (len < 0 || len > MCR_MAX_PDU) {
+            /* lost track of the framing, keep the rest as plain bytes */
+            s->desync = 1;
+            emit_stream(w, conv_id, dir, s->buf.data + off, s->buf.len - off, ts);
+            off = s->buf.len;
+            break;
+        }
+        if ((size_t)len > s->buf.len - off) {
+            break;
+        }
+        emit_pdu(w, conv_id, c, dir, s->buf.data + off, len, ts);
+        off += len;
+    }
+    memmove(s->buf.data, s->buf.data + off, s->buf.len - off);
+    s->buf.len -= off;
+}
+
+static void append_in_order(writer_t *w, uint32_t conv_id, conv_t *c, int dir,
+                            uint32_t seq, const uint8_t *d, uint32_t len, uint64_t ts)
+{
+    stream_t *s = &c->dir[dir];
+    uint32_t skip = s->next_seq - seq;
+
+    if (skip >= len) {
+        return;
+    }
+    d += skip;
+    len -= skip;
+    s->next_seq += len;
+    if (s->desync) {
+        emit_stream(w, conv_id, dir, d, len, ts);
+        return;
+    }
+    buf_put(&s->buf, d, len);
+    frame_pdus(w, conv_id, c, dir, ts);
+}
+
+static void stream_data(writer_t *w, uint32_t conv_id, conv_t *c, int dir,
+                        uint32_t seq, const uint8_t *d, uint32_t len, uint64_t ts)
+{
+    stream_t *s = &c->dir[dir];
+    seg_t *seg, **pp;
+
+    if (!s->have_seq) {
+        s->have_seq = 1;
+        s->next_seq = seq;
+    }
+
+    if ((int32_t)(seq - s->next_seq) <= 0) {
+        append_in_order(w, conv_id, c, dir, seq, d, len, ts);
+    } else {
+        /* hold on to it until the retransmission of the gap turns up */
+        seg = malloc(sizeof(seg_t) + len);
+        seg->seq = seq;
+        seg->len = len;
+        seg->ts = ts;
+        memcpy(seg->data, d, len);
+        for (pp = &s->ooo; *pp && (int32_t)((*pp)->seq - seq) <= 0; pp = &(*pp)->next)
+            ;
+        seg->next = *pp;
+        *pp = seg;
+        s->ooo_bytes += len;
+
+        if (s->ooo_bytes > MCR_MAX_OOO) {
+            /* the gap was never filled in, skip over it */
+            if (!s->desync) {
+                emit_stream(w, conv_id, dir, s->buf.data, s->buf.len, ts);
+                s->buf.len = 0;
+                s->desync = 1;
+            }
+            s->next_seq = s->ooo->seq;
+        }
+    }
+
+    while (s->ooo && (int32_t)(s->ooo->seq - s->next_seq) <= 0) {
+        seg = s->ooo;
+        s->ooo = seg->next;
+        s->ooo_bytes -= seg->len;
+        append_in_order(w, conv_id, c, dir, seg->seq, seg->data, seg->len, seg->ts);
+        free(seg);
+    }
+}
+
+/*
+ * The connection is over: keep whatever is left in the buffer and the out
+ * of order queue as plain bytes, and start the stream over for the next
+ * connection on the same ports.
+ */
+static void end_stream(writer_t *w, uint32_t conv_id, conv_t *c, int dir, uint64_t ts)
+{
+    stream_t *s = &c->dir[dir];
+    seg_t *seg;
+    uint32_t end, skip;
+
+    emit_stream(w, conv_id, dir, s->buf.data, s->buf.len, ts);
+    end = s->ooo ? s->ooo->seq : 0;
+    while ((seg = s->ooo) != NULL) {
+        s->ooo = seg->next;
+        /* queued segments can overlap, don't keep any byte twice */
+        skip = (int32_t)(end - seg->seq) > 0 ? end - seg->seq : 0;
+        if (skip < seg->len) {
+            emit_stream(w, conv_id, dir, seg->data + skip, seg->len - skip, seg->ts);
+            end = seg->seq + seg->len;
+        }
+        free(seg);
+    }
+    free(s->buf.data);
+    memset(s, 0, sizeof(*s));
+}
+
+static uint32_t conv_hash(const uint8_t *client, const uint8_t *server, int addr_len,
+                          uint16_t client_port, uint16_t server_port)
+{
+    uint32_t h = 2166136261u ^ client_port ^ ((uint32_t)server_port << 16);
+    int i;
+
+    for (i = 0; i < addr_len; i++) {
+        h = (h ^ client[i]) * 16777619u;
+        h = (h ^ server[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int conv_matches(const conv_t *c, const mc_tcp_t *tcp, int dir)
+{
+    return c->addr_len == tcp->addr_len &&
+           c->client_port == (dir ? tcp->dport : tcp->sport) &&
+           c->server_port == (dir ? tcp->sport : tcp->dport) &&
+           !memcmp(c->client, dir ? tcp->dst : tcp->src, tcp->addr_len) &&
+           !memcmp(c->server, dir ? tcp->src : tcp->dst, tcp->addr_len);
+}
+
+static uint32_t find_conv(writer_t *w, const mc_tcp_t *tcp, int dir)
+{
+    const uint8_t *client = dir ? tcp->dst : tcp->src, *server = dir ? tcp->src : tcp->dst;
+    uint16_t client_port = dir ? tcp->dport : tcp->sport, server_port = dir ? tcp->sport : tcp->dport;
+    uint32_t i, mask;
+    conv_t *c;
+
+    if (w->nconvs * 2 >= w->conv_slots_size) {
+        free(w->conv_slots);
+        w->conv_slots_size = w->conv_slots_size ? w->conv_slots_size * 2 : 1024;
+        w->conv_slots = calloc(w->conv_slots_size, sizeof(uint32_t));
+        mask = w->conv_slots_size - 1;
+        for (i = 0; i < w->nconvs; i++) {
+            c = w->convs[i];
+            uint32_t j = conv_hash(c->client, c->server, c->addr_len, c->client_port, c->server_port) & mask;
+
+            while (w->conv_slots[j]) {
+                j = (j + 1) & mask;
+            }
+            w->conv_slots[j] = i + 1;
+        }
+        w->convs = realloc(w->convs, w->conv_slots_size / 2 * sizeof(conv_t *));
+    }
+
+    mask = w->conv_slots_size - 1;
+    i = conv_hash(client, server, tcp->addr_len, client_port, server_port) & mask;
+    while (w->conv_slots[i]) {
+        if (conv_matches(w->convs[w->conv_slots[i] - 1], tcp, dir)) {
+            return w->conv_slots[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+
+    c = calloc(1, sizeof(conv_t));
+    c->addr_len = tcp->addr_len;
+    memcpy(c->client, client, tcp->addr_len);
+    memcpy(c->server, server, tcp->addr_len);
+    c->client_port = client_port;
+    c->server_port = server_port;
+    w->convs[w->nconvs] = c;
+    w->conv_slots[i] = ++w->nconvs;
+    return w->nconvs - 1;
+}
+
+static int pack(int argc, char **argv)
+{
+    writer_t w;
+    mc_pcap_t pcap;
+    mc_pcap_rec_t rec;
+    mc_tcp_t tcp;
+    buf_t index = { 0 };
+    uint64_t packets = 0, last_ts = 0;
+    uint32_t i, conv_id;
+    conv_t *cv;
+    stream_t *s;
+    int c, dir;
+
+    memset(&w, 0, sizeof(w));
+    w.port = MC_PORT;
+    optind = 1;
+    while ((c = getopt(argc, argv, "p:")) != -1) {
+        if (c != 'p') {
+            return 2;
+        }
+        w.port = atoi(optarg);
+    }
+    if (argc - optind != 2) {
+        return 2;
+    }
+    if (mc_pcap_open(&pcap, argv[optind]) < 0) {
+        return 1;
+    }
+    w.out = fopen(argv[optind + 1], "wb");
+    if (w.out == NULL) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    setvbuf(w.out, NULL, _IOFBF, 1 << 20);
+
+    buf_put(&index, "MCR2", 4);
+    buf_le(&index, w.port, 4);
+    fwrite(index.data, 1, index.len, w.out);
+    w.file_off = index.len;
+    index.len = 0;
+
+    while (mc_pcap_next(&pcap, &rec)) {
+        packets++;
+        if (!mc_pcap_tcp(&pcap, &rec, &tcp)) {
+            continue;
+        }
+        if (tcp.dport == w.port) {
+            dir = 0;
+        } else if (tcp.sport == w.port) {
+            dir = 1;
+        } else {
+            continue;
+        }
+        conv_id = find_conv(&w, &tcp, dir);
+        cv = w.convs[conv_id];
+        s = &cv->dir[dir];
+        last_ts = rec.ts_us;
+        if (tcp.flags & MC_TCP_SYN) {
+            /* a new connection on the same ports */
+            end_stream(&w, conv_id, cv, dir, rec.ts_us);
+            s->have_seq = 1;
+            s->next_seq = tcp.seq + 1;
+            continue;
+        }
+        if (tcp.payload_len) {
+            stream_data(&w, conv_id, cv, dir, tcp.seq, tcp.payload, tcp.payload_len, rec.ts_us);
+        }
+        if (tcp.flags & MC_TCP_RST) {
+            end_stream(&w, conv_id, cv, 0, rec.ts_us);
+            end_stream(&w, conv_id, cv, 1, rec.ts_us);
+        } else if ((tcp.flags & MC_TCP_FIN) && s->ooo == NULL && s->next_seq == tcp.seq + tcp.payload_len) {
+            /* only once everything before the FIN is in */
+            end_stream(&w, conv_id, cv, dir, rec.ts_us);
+        }
+    }
+    /* and the ones still open when the capture ends */
+    for (i = 0; i < w.nconvs; i++) {
+        end_stream(&w, i, w.convs[i], 0, last_ts);
+        end_stream(&w, i, w.convs[i], 1, last_ts);
+    }
+    flush_block(&w);
+
+    buf_put(&index, "MCRI", 4);
+    buf_le(&index, w.block, 4);
+    buf_put(&index, w.index_blocks.data, w.index_blocks.len);
+    buf_le(&index, w.nconvs, 4);
+    for (i = 0; i < w.nconvs; i++) {
+        cv = w.convs[i];
+        buf_put8(&index, cv->addr_len);
+        buf_put(&index, cv->client, 16);
+        buf_put(&index, cv->server, 16);
+        buf_le(&index, cv->client_port, 2);
+        buf_le(&index, cv->server_port, 2);
+        free(cv);
+    }
+    buf_le(&index, w.nchunks, 4);
+    buf_put(&index, w.index_chunks.data, w.index_chunks.len);
+    buf_le(&index, w.file_off, 8);
+    buf_put(&index, "MCRE", 4);
+    fwrite(index.data, 1, index.len, w.out);
+    w.file_off += index.len;
+
+    if (fclose(w.out) != 0) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    fprintf(stderr, "%llu packets, %llu PDUs in %u conversations, %u map chunks (%llu repeats)\n"
+            "%llu bytes -> %llu bytes\n",
+            (unsigned long long)packets, (unsigned long long)w.pdus, w.nconvs,
+            w.nchunks, (unsigned long long)w.dup_chunks,
+            (unsigned long long)pcap.size, (unsigned long long)w.file_off);
+
+    mc_pcap_close(&pcap);
+    free(w.convs);
+    free(w.conv_slots);
+    free(w.chunk_slots);
+    free(w.raw.data);
+    free(w.index_blocks.data);
+    free(w.index_chunks.data);
+    free(index.data);
+    return 0;
+}
+
+/* ---- reading ---- */
+
+typedef struct {
+    uint64_t off;
+    uint64_t min_ts;
+    uint64_t max_ts;
+    uint32_t records;
+} block_ent_t;
+
+typedef struct {
+    uint32_t block;
+    uint32_t off;
+    uint32_t len;
+} chunk_ent_t;
+
+typedef struct {
+    const uint8_t *map;
+    uint64_t size;
+    int fd;
+    uint32_t nblocks;
+    block_ent_t *blocks;
+    uint32_t nconvs;
+    const uint8_t *convs;
+    uint32_t nchunks;
+    chunk_ent_t *chunks;
+    buf_t cur;              /* block being decoded */
+    buf_t other;            /* last block a chunk was fetched from */
+    uint32_t other_block;
+} reader_t;
+
+static int open_recording(reader_t *r, const char *path)
+{
+    struct stat st;
+    cursor_t c;
+    uint64_t index_off;
+    uint32_t i;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0 || fstat(r->fd, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    r->size = st.st_size;
+    r->map = r->size ? mmap(NULL, r->size, PROT_READ, MAP_SHARED, r->fd, 0) : MAP_FAILED;
+    if (r->map == MAP_FAILED || r->size < 20 || memcmp(r->map, "MCR2", 4) ||
+        memcmp(r->map + r->size - 4, "MCRE", 4)) {
+        fprintf(stderr, "%s: not a recording\n", path);
+        return -1;
+    }
+    index_off = get_le(r->map + r->size - 12, 8);
+    if (index_off > r->size - 12) {
+        fprintf(stderr, "%s: bad index\n", path);
+        return -1;
+    }
+
+    c.p = r->map + index_off;
+    c.end = r->map + r->size - 12;
+    c.bad = 0;
+    if (!cur_bytes(&c, 4) || memcmp(c.p - 4, "MCRI", 4)) {
+        fprintf(stderr, "%s: bad index\n", path);
+        return -1;
+    }
+
+    r->nblocks = cur_le(&c, 4);
+    if ((uint64_t)(c.end - c.p) < (uint64_t)r->nblocks * MCR_BLOCK_LEN) {
+        fprintf(stderr, "%s: bad index\n", path);
+        return -1;
+    }
+    r->blocks = calloc(r->nblocks + 1, sizeof(block_ent_t));
+    for (i = 0; i < r->nblocks; i++) {
+        r->blocks[i].off = cur_le(&c, 8);
+        r->blocks[i].min_ts = cur_le(&c, 8);
+        r->blocks[i].max_ts = cur_le(&c, 8);
+        r->blocks[i].records = cur_le(&c, 4);
+    }
+
+    r->nconvs = cur_le(&c, 4);
+    r->convs = cur_bytes(&c, (uint64_t)r->nconvs * MCR_CONV_LEN);
+
+    r->nchunks = cur_le(&c, 4);
+    if (c.bad || (uint64_t)(c.end - c.p) < (uint64_t)r->nchunks * MCR_CHUNK_LEN) {
+        fprintf(stderr, "%s: bad index\n", path);
+        return -1;
+    }
+    r->chunks = calloc(r->nchunks + 1, sizeof(chunk_ent_t));
+    for (i = 0; i < r->nchunks; i++) {
+        r->chunks[i].block = cur_le(&c, 4);
+        r->chunks[i].off = cur_le(&c, 4);
+        r->chunks[i].len = cur_le(&c, 4);
+    }
+    r->other_block = UINT32_MAX;
+    return 0;
+}
+
+static void close_recording(reader_t *r)
+{
+    free(r->blocks);
+    free(r->chunks);
+    free(r->cur.data);
+    free(r->other.data);
+    munmap((void *)r->map, r->size);
+    close(r->fd);
+}
+
+static int load_block(reader_t *r, uint32_t n, buf_t *into)
+{
+    const uint8_t *hdr = r->map + r->blocks[n].off;
+    uint32_t raw_len, comp_len;
+    uLongf dest_len;
+
+    if (r->blocks[n].off + 12 > r->size || memcmp(hdr, "MCRB", 4)) {
+        return -1;
+    }
+    raw_len = get_le(hdr + 4, 4);
+    comp_len = get_le(hdr + 8, 4);
+    if (r->blocks[n].off + 12 + comp_len > r->size) {
+        return -1;
+    }
+    into->len = 0;
+    buf_reserve(into, raw_len);
+    dest_len = raw_len;
+    if (uncompress(into->data, &dest_len, hdr + 12, comp_len) != Z_OK || dest_len != raw_len) {
+        return -1;
+    }
+    into->len = raw_len;
+    return 0;
+}
+
+/* Returns the payload of Map Chunk id, which may live in another block */
+static const uint8_t *get_chunk(reader_t *r, uint32_t block, uint64_t id)
+{
+    chunk_ent_t *ch;
+    buf_t *b = &r->cur;
+
+    if (id >= r->nchunks) {
+        return NULL;
+    }
+    ch = &r->chunks[id];
+    if (ch->block != block) {
+        if (ch->block != r->other_block) {
+            r->other_block = UINT32_MAX;
+            if (ch->block >= r->nblocks || load_block(r, ch->block, &r->other) < 0) {
+                return NULL;
+            }
+            r->other_block = ch->block;
+        }
+        b = &r->other;
+    }
+    if ((uint64_t)ch->off + ch->len > b->len) {
+        return NULL;
+    }
+    return b->data + ch->off;
+}
+
+/* Per direction state when turning a recording back into packets */
+typedef struct {
+    uint32_t seq[2];
+} replay_conv_t;
+
+static void write_segment(FILE *out, const uint8_t *cv, int dir, replay_conv_t *rc,
+                          const uint8_t *d, uint32_t len, uint64_t ts)
+{
+    uint8_t frame[14 + 40 + 20 + MCR_MSS];
+    const uint8_t *src = cv + 1 + (dir ? 16 : 0), *dst = cv + 1 + (dir ? 0 : 16);
+    uint16_t sport = get_le(cv + 33 + (dir ? 2 : 0), 2), dport = get_le(cv + 33 + (dir ? 0 : 2), 2);
+    int v6 = cv[0] == 16;
+    uint8_t *ip = frame + 14, *th;
+    uint32_t sum = 0, i;
+
+    memset(frame, 0, 14);
+    frame[5] = 1 + dir;
+    frame[11] = 2 - dir;
+    put_be(frame + 12, v6 ? 0x86dd : 0x0800, 2);
+    if (v6) {
+        memset(ip, 0, 40);
+        ip[0] = 0x60;
+        put_be(ip + 4, 20 + len, 2);
+        ip[6] = 6;
+        ip[7] = 64;
+        memcpy(ip + 8, src, 16);
+        memcpy(ip + 24, dst, 16);
+        th = ip + 40;
+    } else {
+        memset(ip, 0, 20);
+        ip[0] = 0x45;
+        put_be(ip + 2, 20 + 20 + len, 2);
+        put_be(ip + 6, 0x4000, 2);
+        ip[8] = 64;
+        ip[9] = 6;
+        memcpy(ip + 12, src, 4);
+        memcpy(ip + 16, dst, 4);
+        for (i = 0; i < 20; i += 2) {
+            sum += get_be(ip + i, 2);
+        }
+        while (sum >> 16) {
+            sum = (sum & 0xffff) + (sum >> 16);
+        }
+        put_be(ip + 10, ~sum & 0xffff, 2);
+        th = ip + 20;
+    }
+    memset(th, 0, 20);
+    put_be(th, sport, 2);
+    put_be(th + 2, dport, 2);
+    put_be(th + 4, rc->seq[dir], 4);
+    put_be(th + 8, rc->seq[!dir], 4);
+    th[12] = 5 << 4;
+    th[13] = 0x18;          /* PSH ACK */
+    put_be(th + 14, 65535, 2);
+    memcpy(th + 20, d, len);
+    rc->seq[dir] += len;
+
+    mc_pcap_write_record(out, ts, frame, (th + 20 + len) - frame);
+}
+
+static void write_pdu(FILE *out, const uint8_t *cv, int dir, replay_conv_t *rc,
+                      const uint8_t *d, size_t len, uint64_t ts)
+{
+    size_t n;
+
+    while (len) {
+        n = len > MCR_MSS ? MCR_MSS : len;
+        write_segment(out, cv, dir, rc, d, n, ts);
+        d += n;
+        len -= n;
+    }
+}
+
+/*
+ * Decode one block and write out the PDUs with timestamps in [start, end].
+ * Returns the number of PDUs written, or -1 if the block is corrupt.
+ */
+static int64_t replay_block(reader_t *r, uint32_t n, FILE *out, replay_conv_t *rcs,
+                            delta_t *deltas, uint64_t start, uint64_t end)
+{
+    cursor_t c;
+    uint8_t pdu[42], kind_dir;
+    const uint8_t *body;
+    uint64_t ts = 0, len, id;
+    uint32_t conv_id, i;
+    int64_t written = 0;
+    int kind, dir;
+    delta_t *delta;
+    buf_t tmp = { 0 };
+
+    if (load_block(r, n, &r->cur) < 0) {
+        return -1;
+    }
+    c.p = r->cur.data;
+    c.end = r->cur.data + r->cur.len;
+    c.bad = 0;
+
+    while (c.p < c.end && !c.bad) {
+        kind_dir = cur_u8(&c);
+        kind = kind_dir & 0x7f;
+        dir = kind_dir >> 7;
+        conv_id = cur_varint(&c);
+        ts += unzigzag(cur_varint(&c));
+        if (conv_id >= r->nconvs) {
+            c.bad = 1;
+            break;
+        }
+        delta = &deltas[conv_id * 2 + dir];
+        if (delta->block != n + 1) {
+            memset(delta, 0, sizeof(*delta));
+            delta->block = n + 1;
+        }
+
+        body = NULL;
+        len = 0;
+        switch (kind) {
+        case REC_RAW:
+        case REC_STREAM:
+            len = cur_varint(&c);
+            body = cur_bytes(&c, len);
+            break;
+        case REC_POS:
+        case REC_POS_LOOK:
+            pdu[0] = kind == REC_POS ? 0x0B : 0x0D;
+            for (i = 0; i < 4; i++) {
+                delta->pos[i] ^= cur_varint(&c);
+                put_be(pdu + 1 + 8 * i, delta->pos[i], 8);
+            }
+            len = 34;
+            if (kind == REC_POS_LOOK) {
+                for (i = 0; i < 2; i++) {
+                    delta->look[i] ^= cur_varint(&c);
+                    put_be(pdu + 33 + 4 * i, delta->look[i], 4);
+                }
+                len = 42;
+            }
+            pdu[len - 1] = cur_u8(&c);
+            body = pdu;
+            break;
+        case REC_MOVE:
+        case REC_LOOK:
+        case REC_MOVE_LOOK:
+            pdu[0] = kind == REC_MOVE ? 0x1F : kind == REC_LOOK ? 0x20 : 0x21;
+            delta->eid += (int32_t)unzigzag(cur_varint(&c));
+            put_be(pdu + 1, (uint32_t)delta->eid, 4);
+            len = 5;
+            if (kind != REC_LOOK) {
+                for (i = 0; i < 3; i++) {
+                    pdu[len++] = cur_u8(&c);
+                }
+            }
+            if (kind != REC_MOVE) {
+                pdu[len++] = cur_u8(&c);
+                pdu[len++] = cur_u8(&c);
+            }
+            body = pdu;
+            break;
+        case REC_CHUNK:
+        case REC_CHUNK_REF:
+            id = cur_varint(&c);
+            body = cur_bytes(&c, MCR_CHUNK_HDR);
+            if (!body) {
+                break;
+            }
+            len = MCR_CHUNK_HDR + (uint64_t)mc_get32(body + 14);
+            tmp.len = 0;
+            buf_put(&tmp, body, MCR_CHUNK_HDR);
+            if (kind == REC_CHUNK) {
+                body = cur_bytes(&c, len - MCR_CHUNK_HDR);
+            } else {
+                body = get_chunk(r, n, id);
+                if (body && r->chunks[id].len != len - MCR_CHUNK_HDR) {
+                    body = NULL;
+                }
+            }
+            if (!body) {
+                c.bad = 1;
+                break;
+            }
+            buf_put(&tmp, body, len - MCR_CHUNK_HDR);
+            body = tmp.data;
+            break;
+        default:
+            c.bad = 1;
+            break;
+        }
+        if (c.bad || body == NULL) {
+            c.bad = 1;
+            break;
+        }
+        if (ts >= start && ts <= end) {
+            write_pdu(out, r->convs + (size_t)conv_id * MCR_CONV_LEN, dir, &rcs[conv_id], body, len, ts);
+            written++;
+        } else {
+            /* keep the sequence numbers continuous across the skipped part */
+            rcs[conv_id].seq[dir] += len;
+        }
+    }
+    free(tmp.data);
+    return c.bad ? -1 : written;
+}
+
+static int unpack(int argc, char **argv)
+{
+    reader_t r;
+    FILE *out;
+    replay_conv_t *rcs;
+    delta_t *deltas;
+    uint64_t start = 0, end = UINT64_MAX, pdus = 0;
+    int64_t n;
+    uint32_t i;
+    int c;
+
+    optind = 1;
+    while ((c = getopt(argc, argv, "s:e:")) != -1) {
+        switch (c) {
+        case 's':
+            start = strtod(optarg, NULL) * 1000000;
+            break;
+        case 'e':
+            end = strtod(optarg, NULL) * 1000000;
+            break;
+        default:
+            return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        return 2;
+    }
+    if (open_recording(&r, argv[optind]) < 0) {
+        return 1;
+    }
+    out = fopen(argv[optind + 1], "wb");
+    if (out == NULL) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    mc_pcap_write_header(out, 1);
+
+    rcs = calloc(r.nconvs + 1, sizeof(replay_conv_t));
+    deltas = calloc(r.nconvs * 2 + 1, sizeof(delta_t));
+    for (i = 0; i < r.nconvs; i++) {
+        rcs[i].seq[0] = rcs[i].seq[1] = 1;
+    }
+
+    for (i = 0; i < r.nblocks; i++) {
+        if (r.blocks[i].max_ts < start || r.blocks[i].min_ts > end) {
+            continue;
+        }
+        n = replay_block(&r, i, out, rcs, deltas, start, end);
+        if (n < 0) {
+            fprintf(stderr, "%s: block %u is corrupt\n", argv[optind], i);
+            return 1;
+        }
+        pdus += n;
+    }
+
+    free(rcs);
+    free(deltas);
+    close_recording(&r);
+    if (fclose(out) != 0) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    fprintf(stderr, "%llu records written\n", (unsigned long long)pdus);
+    return 0;
+}
+
+static int info(int argc, char **argv)
+{
+    reader_t r;
+    uint64_t records = 0, min_ts = UINT64_MAX, max_ts = 0;
+    uint32_t i;
+
+    if (argc != 2) {
+        return 2;
+    }
+    if (open_recording(&r, argv[1]) < 0) {
+        return 1;
+    }
+    for (i = 0; i < r.nblocks; i++) {
+        records += r.blocks[i].records;
+        if (r.blocks[i].min_ts < min_ts) {
+            min_ts = r.blocks[i].min_ts;
+        }
+        if (r.blocks[i].max_ts > max_ts) {
+            max_ts = r.blocks[i].max_ts;
+        }
+    }
+    printf("%s: %llu bytes, %u blocks, %llu records, %u conversations, %u unique map chunks\n",
+           argv[1], (unsigned long long)r.size, r.nblocks, (unsigned long long)records,
+           r.nconvs, r.nchunks);
+    if (r.nblocks) {
+        printf("time: %llu.%06llu - %llu.%06llu\n",
+               (unsigned long long)(min_ts / 1000000),
+               (unsigned long long)(min_ts % 1000000),
+               (unsigned long long)(max_ts / 1000000),
+               (unsigned long long)(max_ts % 1000000));
+    }
+    close_recording(&r);
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mc-record pack [-p port] <in.pcap> <out.mcr>\n"
+                    "       mc-record unpack [-s start] [-e end] <in.mcr> <out.pcap>\n"
+                    "       mc-record info <in.mcr>\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 2;
+
+    if (argc < 2) {
+        usage();
+    }
+    if (!strcmp(argv[1], "pack")) {
+        ret = pack(argc - 1, argv + 1);
+    } else if (!strcmp(argv[1], "unpack")) {
+        ret = unpack(argc - 1, argv + 1);
+    } else if (!strcmp(argv[1], "info")) {
+        ret = info(argc - 1, argv + 1);
+    }
+    if (ret == 2) {
+        usage();
+    }
+    return ret;
+}
@@ -23,11 +23,20 @@ THE SOFTWARE.
 # include "config.h"
 #endif
 
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
 #include <gmodule.h>
 #include <epan/prefs.h>
 #include <epan/packet.h>
+#include <epan/conversation.h>
+#include <epan/emem.h>
+#include <epan/expert.h>
+#include <epan/tap.h>
 #include <epan/dissectors/packet-tcp.h>
 
+#include "packet-minecraft.h"
+
 /* forward reference */
 void proto_register_minecraft();
 void proto_reg_handoff_minecraft();
@@ -40,14 +49,18 @@ G_MODULE_EXPORT const gchar version[] = "0.0";
 
 #define PROTO_TAG_MC "MC"
 
+/* Hard limits for the Complex Entity NBT decoder */
+#define MC_NBT_MAX_DEPTH    32
+#define MC_NBT_MAX_ITEMS    4096
+#define MC_NBT_MAX_INFLATED (1024 * 1024)
+
+/* How far past the end of a skipped body retransmissions of it are expected */
+#define MC_SKIP_WINDOW      (1U << 30)
+
 static int proto_minecraft = -1;
+static int minecraft_tap = -1;
 static dissector_handle_t minecraft_handle;
 
-proto_item *mc_item = NULL;
-proto_item *mc_sub_item = NULL;
-proto_tree *mc_tree = NULL;
-proto_tree *mc_header_tree = NULL;
-
 static const value_string packettypenames[] = {
     { 0x00, "Keep Alive" },
     { 0x01, "Login" },
@@ -98,6 +111,100 @@ static const value_string directionnames[] = {
     {0, NULL}
 };
 
+#define NBT_END        0
+#define NBT_BYTE       1
+#define NBT_SHORT      2
+#define NBT_INT        3
+#define NBT_LONG       4
+#define NBT_FLOAT      5
+#define NBT_DOUBLE     6
+#define NBT_BYTE_ARRAY 7
+#define NBT_STRING     8
+#define NBT_LIST       9
+#define NBT_COMPOUND   10
+
+static const value_string nbttagnames[] = {
+    { NBT_END,        "End" },
+    { NBT_BYTE,       "Byte" },
+    { NBT_SHORT,      "Short" },
+    { NBT_INT,        "Int" },
+    { NBT_LONG,       "Long" },
+    { NBT_FLOAT,      "Float" },
+    { NBT_DOUBLE,     "Double" },
+    { NBT_BYTE_ARRAY, "Byte Array" },
+    { NBT_STRING,     "String" },
+    { NBT_LIST,       "List" },
+    { NBT_COMPOUND,   "Compound" },
+    { 0, NULL }
+};
+
+/* Detail levels for the high volume opcodes */
+#define MC_DETAIL_FULL    0
+#define MC_DETAIL_SUMMARY 1
+#define MC_DETAIL_SAMPLED 2
+
+static const enum_val_t detail_levels[] = {
+    { "full",    "Full",                         MC_DETAIL_FULL },
+    { "summary", "Summary (type and length)",    MC_DETAIL_SUMMARY },
+    { "sampled", "Sampled (full detail 1 in N)", MC_DETAIL_SAMPLED },
+    { NULL, NULL, 0 }
+};
+
+/* Preferences */
+static gboolean mc_decode_nbt = TRUE;
+static gint mc_entity_move_detail = MC_DETAIL_FULL;
+static gint mc_player_position_detail = MC_DETAIL_FULL;
+static guint mc_sample_rate = 100;
+static guint mc_max_string_pdu_len = 4096;
+static guint mc_max_map_chunk_len = 256 * 1024;
+static guint mc_max_multi_block_len = 11 + 4 * 16 * 128 * 16;
+static guint mc_max_complex_entity_len = 32 * 1024;
+static guint mc_reassembly_budget = 4 * 1024 * 1024;
+
+/* Opcodes the sampled detail level applies to, see get_sample_slot() */
+#define MC_SAMPLED_TYPES 5
+
+/*
+ * Per conversation state, kept with conversation_add_proto_data().  The
+ * arrays are indexed by direction, 1 being server to client.
+ */
+typedef struct _mc_conv {
+    guint32 sampled_count[MC_SAMPLED_TYPES];
+    guint32 pending[2];     /* bytes TCP has been asked to reassemble */
+    gboolean skipping[2];   /* skip_end is set */
+    guint32 skip_end[2];    /* TCP seq just past the body of an oversized PDU */
+} mc_conv_t;
+
+/*
+ * Per frame state, kept with p_add_proto_data().  Anything worked out on
+ * the first pass that has to be the same on later passes goes here, in a
+ * tree keyed by get_pdu_key().  So does the inflated NBT of a Complex
+ * Entity, which is only a cache and is filled in on whichever pass first
+ * needs it.
+ */
+#define MC_NBT_NOT_INFLATED 0
+#define MC_NBT_INFLATED     1
+#define MC_NBT_TRUNCATED    2   /* inflated, up to MC_NBT_MAX_INFLATED */
+#define MC_NBT_FAILED       3
+
+typedef struct _mc_pdu_info {
+    gboolean oversized;
+    guint8 nbt_state;
+    guint32 nbt_len;
+    guint8 *nbt;            /* se_alloc'd */
+} mc_pdu_info_t;
+
+typedef struct _mc_frame {
+    guint32 skip;           /* leading bytes belonging to an oversized PDU */
+    emem_tree_t *pdus;
+    /* PDUs of each sampled type in the conversation before the
+       reassembled tvb [0] and the rest of the segment [1] */
+    gboolean has_base[2];
+    guint32 base[2][MC_SAMPLED_TYPES];
+} mc_frame_t;
+
+static mc_pdu_info_t *get_pdu_info(tvbuff_t *tvb, packet_info *pinfo, guint32 offset, gboolean create);
+
 #ifndef ENABLE_STATIC
 G_MODULE_EXPORT void plugin_register(void)
 {
@@ -110,13 +217,22 @@ G_MODULE_EXPORT void plugin_register(void)
 G_MODULE_EXPORT void plugin_reg_handoff(void) {
     proto_reg_handoff_minecraft();
 }
+
+/* tshark calls this for plugins before it parses the -z options */
+G_MODULE_EXPORT void plugin_register_tap_listener(void)
+{
+    register_tap_listener_minecraft_ticks();
+    register_tap_listener_minecraft_chunks();
+}
 #endif
 
 static int ett_mc = -1;
+static int ett_mc_nbt = -1;
 
 /* Setup protocol subtree array */
 static int *ett[] = {
-    &ett_mc
+    &ett_mc,
+    &ett_mc_nbt
 };
 static gint hf_mc_data = -1;
 static gint hf_mc_type = -1;
@@ -158,6 +274,36 @@ static gint hf_mc_block_meta_byte = -1;
 static gint hf_mc_item_code = -1;
 static gint hf_mc_amount = -1;
 static gint hf_mc_life = -1;
+static gint hf_mc_opcode_seq = -1;
+static gint hf_mc_declared_length = -1;
+static gint hf_mc_skipped = -1;
+static gint hf_mc_nbt_length = -1;
+static gint hf_mc_nbt_compound = -1;
+static gint hf_mc_nbt_list = -1;
+static gint hf_mc_nbt_list_type = -1;
+static gint hf_mc_nbt_byte = -1;
+static gint hf_mc_nbt_short = -1;
+static gint hf_mc_nbt_int = -1;
+static gint hf_mc_nbt_long = -1;
+static gint hf_mc_nbt_float = -1;
+static gint hf_mc_nbt_double = -1;
+static gint hf_mc_nbt_byte_array = -1;
+static gint hf_mc_nbt_string = -1;
+
+/* Decoding the NBT is only worth it if one of these ends up being used */
+static gint *hf_mc_nbt_fields[] = {
+    &hf_mc_nbt_compound,
+    &hf_mc_nbt_list,
+    &hf_mc_nbt_list_type,
+    &hf_mc_nbt_byte,
+    &hf_mc_nbt_short,
+    &hf_mc_nbt_int,
+    &hf_mc_nbt_long,
+    &hf_mc_nbt_float,
+    &hf_mc_nbt_double,
+    &hf_mc_nbt_byte_array,
+    &hf_mc_nbt_string
+};
 
 void proto_register_minecraft(void)
 {
@@ -286,6 +432,51 @@ void proto_register_minecraft(void)
             { &hf_mc_life,
               {"Life", "mc.life", FT_INT16, BASE_DEC, NULL, 0x0, "Life", HFILL }
             },
+            { &hf_mc_opcode_seq,
+              {"Type Count", "mc.type_count", FT_UINT32, BASE_DEC, NULL, 0x0, "Number of PDUs of this type so far in the conversation", HFILL }
+            },
+            { &hf_mc_declared_length,
+              {"Declared Length", "mc.declared_length", FT_UINT32, BASE_DEC, NULL, 0x0, "Length of an oversized PDU according to its header", HFILL }
+            },
+            { &hf_mc_skipped,
+              {"Skipped", "mc.skipped", FT_UINT32, BASE_DEC, NULL, 0x0, "Body bytes of an oversized PDU that were not dissected", HFILL }
+            },
+            { &hf_mc_nbt_length,
+              {"NBT Length", "mc.nbt_length", FT_UINT16, BASE_DEC, NULL, 0x0, "Compressed NBT Length", HFILL }
+            },
+            { &hf_mc_nbt_compound,
+              {"Compound", "mc.nbt.compound", FT_NONE, BASE_NONE, NULL, 0x0, "NBT Compound", HFILL }
+            },
+            { &hf_mc_nbt_list,
+              {"List", "mc.nbt.list", FT_INT32, BASE_DEC, NULL, 0x0, "NBT List Length", HFILL }
+            },
+            { &hf_mc_nbt_list_type,
+              {"List Type", "mc.nbt.list_type", FT_UINT8, BASE_DEC, VALS(nbttagnames), 0x0, "NBT List Element Type", HFILL }
+            },
+            { &hf_mc_nbt_byte,
+              {"Byte", "mc.nbt.byte", FT_INT8, BASE_DEC, NULL, 0x0, "NBT Byte", HFILL }
+            },
+            { &hf_mc_nbt_short,
+              {"Short", "mc.nbt.short", FT_INT16, BASE_DEC, NULL, 0x0, "NBT Short", HFILL }
+            },
+            { &hf_mc_nbt_int,
+              {"Int", "mc.nbt.int", FT_INT32, BASE_DEC, NULL, 0x0, "NBT Int", HFILL }
+            },
+            { &hf_mc_nbt_long,
+              {"Long", "mc.nbt.long", FT_INT64, BASE_DEC, NULL, 0x0, "NBT Long", HFILL }
+            },
+            { &hf_mc_nbt_float,
+              {"Float", "mc.nbt.float", FT_FLOAT, BASE_DEC, NULL, 0x0, "NBT Float", HFILL }
+            },
+            { &hf_mc_nbt_double,
+              {"Double", "mc.nbt.double", FT_DOUBLE, BASE_DEC, NULL, 0x0, "NBT Double", HFILL }
+            },
+            { &hf_mc_nbt_byte_array,
+              {"Byte Array", "mc.nbt.byte_array", FT_BYTES, BASE_NONE, NULL, 0x0, "NBT Byte Array", HFILL }
+            },
+            { &hf_mc_nbt_string,
+              {"String", "mc.nbt.string", FT_STRING, BASE_NONE, NULL, 0x0, "NBT String", HFILL }
+            },
 
         };
         proto_minecraft = proto_register_protocol (
@@ -299,6 +490,46 @@ void proto_register_minecraft(void)
         proto_register_field_array(proto_minecraft, hf, array_length(hf));
         proto_register_subtree_array(ett, array_length(ett));
 
+        minecraft_tap = register_tap("minecraft");
+
+        prefs_register_bool_preference(module, "decode_nbt",
+                                       "Decode Complex Entity NBT",
+                                       "Inflate and decode the NBT payload of Complex Entity (0x3b) packets",
+                                       &mc_decode_nbt);
+        prefs_register_enum_preference(module, "entity_move_detail",
+                                       "Entity movement detail",
+                                       "How much of Relative Entity Move, Entity Look and Relative Entity Move + Look (0x1F-0x21) to decode",
+                                       &mc_entity_move_detail, detail_levels, FALSE);
+        prefs_register_enum_preference(module, "player_position_detail",
+                                       "Player position detail",
+                                       "How much of Player Position and Player Move + Look (0x0B, 0x0D) to decode",
+                                       &mc_player_position_detail, detail_levels, FALSE);
+        prefs_register_uint_preference(module, "sample_rate",
+                                       "Sample rate",
+                                       "With the sampled detail level, decode 1 of every this many PDUs of each type in full",
+                                       10, &mc_sample_rate);
+        prefs_register_uint_preference(module, "max_string_pdu_len",
+                                       "Maximum Login/Handshake/Chat/Kick length",
+                                       "Longer Login, Handshake, Chat and Kick PDUs are treated as oversized",
+                                       10, &mc_max_string_pdu_len);
+        prefs_register_uint_preference(module, "max_map_chunk_len",
+                                       "Maximum Map Chunk length",
+                                       "Longer Map Chunk (0x33) PDUs are treated as oversized",
+                                       10, &mc_max_map_chunk_len);
+        prefs_register_uint_preference(module, "max_multi_block_len",
+                                       "Maximum Multi Block Change length",
+                                       "Longer Multi Block Change (0x34) PDUs are treated as oversized",
+                                       10, &mc_max_multi_block_len);
+        prefs_register_uint_preference(module, "max_complex_entity_len",
+                                       "Maximum Complex Entity length",
+                                       "Longer Complex Entity (0x3b) PDUs are treated as oversized",
+                                       10, &mc_max_complex_entity_len);
+        prefs_register_uint_preference(module, "reassembly_budget",
+                                       "Reassembly budget per conversation",
+                                       "PDUs that would make TCP hold more than this many bytes for one conversation "
+                                       "have their header dissected and their body skipped",
+                                       10, &mc_reassembly_budget);
+
     }
 }
 
@@ -306,10 +537,11 @@ void proto_reg_handoff_minecraft(void)
 {
     static int Initialized=FALSE;
 
-    /* register with wireshark to dissect udp packets on port 3001 */
+    /* register with wireshark to dissect tcp packets on port 25565 */
     if (!Initialized) {
         minecraft_handle = create_dissector_handle(dissect_minecraft, proto_minecraft);
         dissector_add("tcp.port", 25565, minecraft_handle);
+        Initialized = TRUE;
     }
 }
 
@@ -482,12 +714,254 @@ static void add_spawn_details( proto_tree *tree, tvbuff_t *tvb, packet_info *pin
     proto_tree_add_item(tree, hf_mc_zint, tvb, offset + 9, 4, FALSE);
 }
 
+/*
+ * Inflate a gzip'd NBT blob into se memory and return it, NULL if nothing
+ * came out.  Output is capped at MC_NBT_MAX_INFLATED; anything past that
+ * is dropped, *truncated is set and the NBT walker will see a short
+ * buffer.
+ */
+static guint8 *mc_nbt_inflate(tvbuff_t *tvb, guint32 offset, guint32 length, guint32 *inflated, gboolean *truncated)
+{
+    z_stream strm;
+    const guint8 *in;
+    guint8 *out, *nbt;
+    guint out_size;
+    int ret;
+
+    /* throws on a short capture, so before anything needs freeing */
+    in = tvb_get_ptr(tvb, offset, length);
+
+    *truncated = FALSE;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, MAX_WBITS + 32) != Z_OK) {
+        return NULL;
+    }
+    out_size = MIN(length * 4 + 64, MC_NBT_MAX_INFLATED);
+    out = g_malloc(out_size);
+
+    strm.next_in = (Bytef *)in;
+    strm.avail_in = length;
+    for (;;) {
+        strm.next_out = out + strm.total_out;
+        strm.avail_out = out_size - strm.total_out;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END || (ret != Z_OK && ret != Z_BUF_ERROR)) {
+            break;
+        }
+        if (strm.avail_out == 0) {
+            if (out_size == MC_NBT_MAX_INFLATED) {
+                *truncated = TRUE;
+                break;
+            }
+            out_size = MIN(out_size * 2, MC_NBT_MAX_INFLATED);
+            out = g_realloc(out, out_size);
+        } else if (strm.avail_in == 0) {
+            break;
+        }
+    }
+    inflateEnd(&strm);
+
+    nbt = NULL;
+    *inflated = strm.total_out;
+    if (strm.total_out) {
+        nbt = se_alloc(strm.total_out);
+        memcpy(nbt, out, strm.total_out);
+    }
+    g_free(out);
+    return nbt;
+}
+
+/*
+ * Decode one NBT tag starting at offset and return the offset just past it,
+ * or -1 if the data ran out or one of the hard limits was hit.  List
+ * elements are unnamed, so they are passed in with named == FALSE.
+ */
+static gint dissect_nbt_tag(proto_tree *tree, tvbuff_t *tvb, gint offset, guint8 type, gboolean named, guint depth, guint *items)
+{
+    proto_item *ti = NULL;
+    proto_tree *sub;
+    const guint8 *name = NULL;
+    gint start = offset;
+    gint len, count, i;
+    guint8 elem_type;
+
+    if (++(*items) > MC_NBT_MAX_ITEMS || depth > MC_NBT_MAX_DEPTH) {
+        proto_tree_add_text(tree, tvb, offset, 0, "NBT limits reached, rest not decoded");
+        return -1;
+    }
+
+    if (named) {
+        if (!tvb_bytes_exist(tvb, offset, 2)) {
+            return -1;
+        }
+        len = tvb_get_ntohs(tvb, offset);
+        if (!tvb_bytes_exist(tvb, offset + 2, len)) {
+            return -1;
+        }
+        name = tvb_get_ephemeral_string(tvb, offset + 2, len);
+        offset += 2 + len;
+    }
+
+    switch (type) {
+    case NBT_BYTE:
+    case NBT_SHORT:
+    case NBT_INT:
+    case NBT_LONG:
+    case NBT_FLOAT:
+    case NBT_DOUBLE:
+    {
+        static const gint sizes[] = { 0, 1, 2, 4, 8, 4, 8 };
+        gint *hfs[] = { NULL, &hf_mc_nbt_byte, &hf_mc_nbt_short, &hf_mc_nbt_int,
+                        &hf_mc_nbt_long, &hf_mc_nbt_float, &hf_mc_nbt_double };
+
+        if (!tvb_bytes_exist(tvb, offset, sizes[type])) {
+            return -1;
+        }
+        ti = proto_tree_add_item(tree, *hfs[type], tvb, offset, sizes[type], FALSE);
+        offset += sizes[type];
+    }
+    break;
+    case NBT_BYTE_ARRAY:
+        if (!tvb_bytes_exist(tvb, offset, 4)) {
+            return -1;
+        }
+        len = tvb_get_ntohl(tvb, offset);
+        if (len < 0 || !tvb_bytes_exist(tvb, offset + 4, len)) {
+            return -1;
+        }
+        ti = proto_tree_add_item(tree, hf_mc_nbt_byte_array, tvb, offset + 4, len, FALSE);
+        offset += 4 + len;
+        break;
+    case NBT_STRING:
+        if (!tvb_bytes_exist(tvb, offset, 2)) {
+            return -1;
+        }
+        len = tvb_get_ntohs(tvb, offset);
+        if (!tvb_bytes_exist(tvb, offset + 2, len)) {
+            return -1;
+        }
+        ti = proto_tree_add_item(tree, hf_mc_nbt_string, tvb, offset + 2, len, FALSE);
+        offset += 2 + len;
+        break;
+    case NBT_LIST:
+        if (!tvb_bytes_exist(tvb, offset, 5)) {
+            return -1;
+        }
+        elem_type = tvb_get_guint8(tvb, offset);
+        count = tvb_get_ntohl(tvb, offset + 1);
+        ti = proto_tree_add_item(tree, hf_mc_nbt_list, tvb, offset + 1, 4, FALSE);
+        sub = proto_item_add_subtree(ti, ett_mc_nbt);
+        proto_tree_add_item(sub, hf_mc_nbt_list_type, tvb, offset, 1, FALSE);
+        offset += 5;
+        for (i = 0; i < count; i++) {
+            offset = dissect_nbt_tag(sub, tvb, offset, elem_type, FALSE, depth + 1, items);
+            if (offset < 0) {
+                break;
+            }
+        }
+        break;
+    case NBT_COMPOUND:
+        ti = proto_tree_add_item(tree, hf_mc_nbt_compound, tvb, start, -1, FALSE);
+        sub = proto_item_add_subtree(ti, ett_mc_nbt);
+        for (;;) {
+            if (!tvb_bytes_exist(tvb, offset, 1)) {
+                offset = -1;
+                break;
+            }
+            elem_type = tvb_get_guint8(tvb, offset);
+            if (elem_type == NBT_END) {
+                offset += 1;
+                break;
+            }
+            offset = dissect_nbt_tag(sub, tvb, offset + 1, elem_type, TRUE, depth + 1, items);
+            if (offset < 0) {
+                break;
+            }
+        }
+        break;
+    default:
+        proto_tree_add_text(tree, tvb, start, -1, "Unknown NBT tag type: %d", type);
+        return -1;
+    }
+
+    if (ti && name && *name) {
+        proto_item_append_text(ti, " (%s)", name);
+    }
+    if (ti && offset > start) {
+        proto_item_set_end(ti, tvb, offset);
+    }
+    return offset;
+}
+
+static gboolean nbt_is_wanted(proto_tree *tree)
+{
+    guint i;
+
+    for (i = 0; i < array_length(hf_mc_nbt_fields); i++) {
+        if (proto_field_is_referenced(tree, *hf_mc_nbt_fields[i])) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * The inflated NBT of the Complex Entity at offset.  It's inflated the
+ * first time the tree is wanted and kept with the frame, so going back to
+ * the packet or filtering on mc.nbt again doesn't inflate it again.
+ */
+static tvbuff_t *get_complex_entity_nbt(tvbuff_t *tvb, packet_info *pinfo, guint32 offset, guint16 nbt_len, gboolean *truncated)
+{
+    mc_pdu_info_t *pdu;
+    tvbuff_t *nbt_tvb;
+
+    pdu = get_pdu_info(tvb, pinfo, offset, TRUE);
+    if (pdu->nbt_state == MC_NBT_NOT_INFLATED) {
+        pdu->nbt = mc_nbt_inflate(tvb, offset + 13, nbt_len, &pdu->nbt_len, truncated);
+        pdu->nbt_state = pdu->nbt == NULL ? MC_NBT_FAILED : *truncated ? MC_NBT_TRUNCATED : MC_NBT_INFLATED;
+    }
+    if (pdu->nbt_state == MC_NBT_FAILED) {
+        return NULL;
+    }
+    *truncated = pdu->nbt_state == MC_NBT_TRUNCATED;
+    nbt_tvb = tvb_new_child_real_data(tvb, pdu->nbt, pdu->nbt_len, pdu->nbt_len);
+    add_new_data_source(pinfo, nbt_tvb, "Inflated NBT");
+    return nbt_tvb;
+}
+
 static void add_complex_entity_details( proto_tree *tree, tvbuff_t *tvb, packet_info *pinfo, guint32 offset)
 {
+    tvbuff_t *nbt_tvb;
+    proto_tree *nbt_tree;
+    guint16 nbt_len;
+    guint items = 0;
+    gboolean truncated;
+
     proto_tree_add_item(tree, hf_mc_xint, tvb, offset + 1, 4, FALSE);
     proto_tree_add_item(tree, hf_mc_yshort, tvb, offset + 5, 2, FALSE);
     proto_tree_add_item(tree, hf_mc_zint, tvb, offset + 7, 4, FALSE);
+    proto_tree_add_item(tree, hf_mc_nbt_length, tvb, offset + 11, 2, FALSE);
 
+    /* Only inflate when the tree is being shown or filtered on */
+    nbt_len = tvb_get_ntohs(tvb, offset + 11);
+    if (!mc_decode_nbt || nbt_len == 0 || !nbt_is_wanted(tree)) {
+        return;
+    }
+    nbt_tvb = get_complex_entity_nbt(tvb, pinfo, offset, nbt_len, &truncated);
+    if (nbt_tvb == NULL) {
+        proto_tree_add_text(tree, tvb, offset + 13, nbt_len, "NBT (failed to inflate)");
+        return;
+    }
+    nbt_tree = proto_item_add_subtree(
+                   proto_tree_add_text(tree, tvb, offset + 13, nbt_len, "NBT (%u bytes inflated)", tvb_length(nbt_tvb)),
+                   ett_mc_nbt);
+    if (tvb_length(nbt_tvb) >= 1) {
+        dissect_nbt_tag(nbt_tree, nbt_tvb, 1, tvb_get_guint8(nbt_tvb, 0), TRUE, 0, &items);
+    }
+    if (truncated) {
+        proto_tree_add_text(nbt_tree, nbt_tvb, tvb_length(nbt_tvb), 0,
+                            "Inflated NBT over %u bytes, rest not decoded", MC_NBT_MAX_INFLATED);
+    }
 }
 static void add_collect_item_details( proto_tree *tree, tvbuff_t *tvb, packet_info *pinfo, guint32 offset)
 {
@@ -538,8 +1012,23 @@ static void add_relative_entity_move_look_details( proto_tree *tree, tvbuff_t *t
 
 }
 
-static void dissect_minecraft_message(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, guint8 type,  guint32 offset, guint32 length)
+/*
+ * Decoding a PDU only touches the stack and the tvb/pinfo it is handed,
+ * but the dissector keeps state between PDUs: per conversation (type
+ * counts, bytes pending reassembly, oversized bodies to skip) and per
+ * frame (first pass decisions, inflated NBT), both se_alloc'd, and the
+ * tap info is ep_alloc'd.  The file-scope registration data and
+ * preferences are only written at startup.  So different conversations can be dissected at the
+ * same time, as far as epan's allocators allow, but a conversation's
+ * frames must be dissected by one thread at a time and in order.
+ * test/mc-stress.c checks this.
+ */
+static proto_item *dissect_minecraft_message(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, guint8 type,  guint32 offset, guint32 length,
+                                             guint32 seq, gboolean detailed)
 {
+    proto_item *mc_item = NULL;
+    proto_tree *mc_tree;
+
     if (check_col(pinfo->cinfo, COL_PROTOCOL))
         col_set_str(pinfo->cinfo, COL_PROTOCOL, PROTO_TAG_MC);
     /* Clear out stuff in the info column */
@@ -558,6 +1047,12 @@ static void dissect_minecraft_message(tvbuff_t *tvb, packet_info *pinfo, proto_t
 
         proto_tree_add_item(mc_tree, hf_mc_type, tvb, offset, 1, FALSE);
         proto_tree_add_item(mc_tree, hf_mc_data, tvb, offset, length, FALSE);
+        if (seq) {
+            PROTO_ITEM_SET_GENERATED(proto_tree_add_uint(mc_tree, hf_mc_opcode_seq, tvb, offset, 1, seq));
+        }
+        if (!detailed) {
+            return mc_item;
+        }
         switch (type) {
         case 0x01:
             add_login_details(mc_tree, tvb, pinfo, offset);
@@ -640,10 +1135,11 @@ static void dissect_minecraft_message(tvbuff_t *tvb, packet_info *pinfo, proto_t
             break;
         }
     }
+    return mc_item;
 }
 
-guint get_minecraft_packet_len(guint8 type,guint offset, guint available, tvbuff_t *tvb) {
-    guint len=-1;
+static gint get_minecraft_packet_len(guint8 type, guint offset, guint available, tvbuff_t *tvb) {
+    gint len=-1;
     switch (type) {
     case 0x00:
         len = 1;
@@ -774,7 +1270,9 @@ guint get_minecraft_packet_len(guint8 type,guint offset, guint available, tvbuff
         break;
     case 0x33:
         if ( available >= 18 ) {
-            len = 18 + tvb_get_ntohl(tvb, offset + 14);
+            guint32 chunk_len = tvb_get_ntohl(tvb, offset + 14);
+            /* don't let a bogus length wrap around */
+            len = chunk_len > G_MAXINT - 18 ? G_MAXINT : (gint)(18 + chunk_len);
         }
         break;
     case 0x34:
@@ -798,34 +1296,451 @@ guint get_minecraft_packet_len(guint8 type,guint offset, guint available, tvbuff
         }
         break;
     default:
-        printf("Unknown packet: 0x%x\n", type);
+        /* unknown type, let the caller decide what to do with it */
         len = -1;
     }
     return len;
 
 }
 
+static gint get_detail_level(guint8 type)
+{
+    switch (type) {
+    case 0x1F:
+    case 0x20:
+    case 0x21:
+        return mc_entity_move_detail;
+    case 0x0B:
+    case 0x0D:
+        return mc_player_position_detail;
+    }
+    return MC_DETAIL_FULL;
+}
+
+static mc_conv_t *get_mc_conv(conversation_t *conversation)
+{
+    mc_conv_t *conv;
+
+    conv = conversation_get_proto_data(conversation, proto_minecraft);
+    if (conv == NULL) {
+        conv = se_alloc0(sizeof(mc_conv_t));
+        conversation_add_proto_data(conversation, proto_minecraft, conv);
+    }
+    return conv;
+}
+
+static mc_frame_t *get_mc_frame(packet_info *pinfo, gboolean create)
+{
+    mc_frame_t *frame;
+
+    frame = p_get_proto_data(pinfo->fd, proto_minecraft);
+    if (frame == NULL && create) {
+        frame = se_alloc0(sizeof(mc_frame_t));
+        p_add_proto_data(pinfo->fd, proto_minecraft, frame);
+    }
+    return frame;
+}
+
+/*
+ * The offset in the tvb alone doesn't tell a frame's PDUs apart: the
+ * reassembled tvb TCP hands us and the subset with the rest of the
+ * segment both start at 0.  A subset's raw offset is past the frame's
+ * link/IP/TCP headers while reassembled data has none, so use that.
+ */
+static guint32 get_pdu_key(tvbuff_t *tvb, guint32 offset)
+{
+    gint raw = tvb_raw_offset(tvb);
+
+    return raw == 0 ? 0x80000000 | offset : raw + offset;
+}
+
+static mc_pdu_info_t *get_pdu_info(tvbuff_t *tvb, packet_info *pinfo, guint32 offset, gboolean create)
+{
+    mc_frame_t *frame;
+    mc_pdu_info_t *pdu;
+    guint32 key;
+
+    frame = get_mc_frame(pinfo, create);
+    if (frame == NULL) {
+        return NULL;
+    }
+    key = get_pdu_key(tvb, offset);
+    if (frame->pdus) {
+        pdu = se_tree_lookup32(frame->pdus, key);
+        if (pdu) {
+            return pdu;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    if (frame->pdus == NULL) {
+        frame->pdus = se_tree_create_non_persistent(EMEM_TREE_TYPE_RED_BLACK, "Minecraft PDUs");
+    }
+    pdu = se_alloc0(sizeof(mc_pdu_info_t));
+    se_tree_insert32(frame->pdus, key, pdu);
+    return pdu;
+}
+
+static gint get_sample_slot(guint8 type)
+{
+    switch (type) {
+    case 0x0B:
+        return 0;
+    case 0x0D:
+        return 1;
+    case 0x1F:
+        return 2;
+    case 0x20:
+        return 3;
+    case 0x21:
+        return 4;
+    }
+    return -1;
+}
+
+/*
+ * Number a PDU dissected at the sampled detail level among those of the
+ * same type in the conversation.  position is how many PDUs of the type
+ * came before it in this tvb.  Rather than a number per PDU, the frame
+ * keeps one count per type taken on the first pass when the tvb starts,
+ * so sampling picks the same PDUs every time the packet is dissected for
+ * one allocation per frame.
+ */
+static guint32 get_pdu_seq(tvbuff_t *tvb, packet_info *pinfo, mc_conv_t *conv, mc_frame_t **frame,
+                           gint slot, guint32 position)
+{
+    guint part;
+
+    if (*frame == NULL) {
+        *frame = get_mc_frame(pinfo, !pinfo->fd->flags.visited);
+        if (*frame == NULL) {
+            return 0;
+        }
+    }
+    /* see get_pdu_key() */
+    part = tvb_raw_offset(tvb) != 0;
+    if (!(*frame)->has_base[part]) {
+        if (pinfo->fd->flags.visited) {
+            return 0;
+        }
+        memcpy((*frame)->base[part], conv->sampled_count, sizeof(conv->sampled_count));
+        (*frame)->has_base[part] = TRUE;
+    }
+    if (!pinfo->fd->flags.visited) {
+        conv->sampled_count[slot]++;
+    }
+    return (*frame)->base[part][slot] + position + 1;
+}
+
+/* Chunk column a player coordinate is in, FALSE if it's outside the world */
+static gboolean get_player_chunk(tvbuff_t *tvb, guint32 offset, gint32 *chunk)
+{
+    gdouble v = tvb_get_ntohieee_double(tvb, offset);
+
+    if (!(v > -32000000.0 && v < 32000000.0)) {
+        return FALSE;
+    }
+    *chunk = (gint32)floor(v) >> 4;
+    return TRUE;
+}
+
+/* Make room for one more element in an ep_alloc'd array */
+static void *grow_tap_array(void *array, guint num, guint *max, gsize size)
+{
+    void *grown;
+
+    if (num < *max) {
+        return array;
+    }
+    *max = *max ? *max * 2 : 16;
+    grown = ep_alloc(*max * size);
+    if (num) {
+        memcpy(grown, array, num * size);
+    }
+    return grown;
+}
+
+/* Tap info for the PDUs in this tvb, NULL if nobody is listening */
+static mc_tap_info_t *new_tap_info(packet_info *pinfo, conversation_t *conversation)
+{
+    mc_tap_info_t *info;
+
+    if (!have_tap_listener(minecraft_tap)) {
+        return NULL;
+    }
+    info = ep_alloc0(sizeof(mc_tap_info_t));
+    info->from_server = pinfo->match_port == pinfo->srcport;
+    info->conv_index = conversation->index;
+    info->server_port = info->from_server ? pinfo->srcport : pinfo->destport;
+    info->client_port = info->from_server ? pinfo->destport : pinfo->srcport;
+    return info;
+}
+
+static void tap_minecraft_message(mc_tap_info_t *info, tvbuff_t *tvb, guint8 type, guint32 offset, guint32 length)
+{
+    mc_tap_pdu_t *pdu;
+    mc_tap_chunk_t chunk;
+
+    if (info == NULL) {
+        return;
+    }
+    info->pdus = grow_tap_array(info->pdus, info->num_pdus, &info->max_pdus, sizeof(mc_tap_pdu_t));
+    pdu = &info->pdus[info->num_pdus++];
+    pdu->type = type;
+    pdu->length = length;
+
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.type = type;
+    switch (type) {
+    case 0x0B:
+    case 0x0D:
+        if (!tvb_bytes_exist(tvb, offset, 33) ||
+            !get_player_chunk(tvb, offset + 1, &chunk.chunk_x) ||
+            !get_player_chunk(tvb, offset + 25, &chunk.chunk_z)) {
+            return;
+        }
+        break;
+    case 0x32:
+        if (!tvb_bytes_exist(tvb, offset, 10)) {
+            return;
+        }
+        chunk.chunk_x = tvb_get_ntohl(tvb, offset + 1);
+        chunk.chunk_z = tvb_get_ntohl(tvb, offset + 5);
+        chunk.load = tvb_get_guint8(tvb, offset + 9) != 0;
+        break;
+    case 0x33:
+        if (!tvb_bytes_exist(tvb, offset, 14)) {
+            return;
+        }
+        chunk.chunk_x = (gint32)tvb_get_ntohl(tvb, offset + 1) >> 4;
+        chunk.chunk_z = (gint32)tvb_get_ntohl(tvb, offset + 7) >> 4;
+        chunk.size_x = tvb_get_guint8(tvb, offset + 11);
+        chunk.size_y = tvb_get_guint8(tvb, offset + 12);
+        chunk.size_z = tvb_get_guint8(tvb, offset + 13);
+        break;
+    default:
+        return;
+    }
+    info->chunks = grow_tap_array(info->chunks, info->num_chunks, &info->max_chunks, sizeof(mc_tap_chunk_t));
+    info->chunks[info->num_chunks++] = chunk;
+}
+
+static guint get_max_pdu_len(guint8 type)
+{
+    switch (type) {
+    case 0x01:
+    case 0x02:
+    case 0x03:
+    case 0xff:
+        return mc_max_string_pdu_len;
+    case 0x33:
+        return mc_max_map_chunk_len;
+    case 0x34:
+        return mc_max_multi_block_len;
+    case 0x3b:
+        return mc_max_complex_entity_len;
+    }
+    return 0;
+}
+
+/*
+ * Decide whether the PDU at offset, of which only available bytes are in
+ * this tvb, may be handed to TCP for reassembly.  It may not if its
+ * declared length is over the limit for its type, or if buffering it
+ * would take the conversation over its reassembly budget.  The decision
+ * is made on the first pass and remembered.
+ */
+static gboolean is_oversized(tvbuff_t *tvb, packet_info *pinfo, mc_conv_t *conv, guint dir, guint8 type,
+                             guint32 offset, gint len, gint available)
+{
+    mc_pdu_info_t *pdu;
+    guint max;
+    gboolean oversized;
+
+    if (pinfo->fd->flags.visited) {
+        pdu = get_pdu_info(tvb, pinfo, offset, FALSE);
+        return pdu && pdu->oversized;
+    }
+
+    if (len == -1) {
+        oversized = (guint)available + conv->pending[!dir] > mc_reassembly_budget;
+    } else {
+        max = get_max_pdu_len(type);
+        oversized = (max && (guint)len > max) ||
+                    (guint)len + conv->pending[!dir] > mc_reassembly_budget;
+    }
+    if (oversized) {
+        pdu = get_pdu_info(tvb, pinfo, offset, TRUE);
+        pdu->oversized = TRUE;
+    }
+    return oversized;
+}
+
+/*
+ * Dissect what we have of an oversized PDU, which is at least its header,
+ * and arrange for the rest of its body to be skipped as it arrives.
+ */
+static void dissect_oversized_message(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, mc_conv_t *conv, guint dir,
+                                      guint8 type, guint32 offset, gint len, gint available)
+{
+    struct tcpinfo *tcpinfo = pinfo->private_data;
+    proto_item *mc_item;
+    proto_tree *mc_tree;
+
+    mc_item = dissect_minecraft_message(tvb, pinfo, tree, type, offset, available, 0, FALSE);
+    if (mc_item && len != -1) {
+        mc_tree = proto_item_add_subtree(mc_item, ett_mc);
+        switch (type) {
+        case 0x33:
+            add_map_chunk_details(mc_tree, tvb, pinfo, offset);
+            break;
+        case 0x34:
+            proto_tree_add_item(mc_tree, hf_mc_xint, tvb, offset + 1, 4, FALSE);
+            proto_tree_add_item(mc_tree, hf_mc_zint, tvb, offset + 5, 4, FALSE);
+            break;
+        case 0x3b:
+            proto_tree_add_item(mc_tree, hf_mc_xint, tvb, offset + 1, 4, FALSE);
+            proto_tree_add_item(mc_tree, hf_mc_yshort, tvb, offset + 5, 2, FALSE);
+            proto_tree_add_item(mc_tree, hf_mc_zint, tvb, offset + 7, 4, FALSE);
+            proto_tree_add_item(mc_tree, hf_mc_nbt_length, tvb, offset + 11, 2, FALSE);
+            break;
+        }
+        PROTO_ITEM_SET_GENERATED(proto_tree_add_uint(mc_tree, hf_mc_declared_length, tvb, offset, available, len));
+    }
+
+    if (len == -1) {
+        expert_add_info_format(pinfo, mc_item, PI_MALFORMED, PI_WARN,
+                               "Unparseable data over the reassembly budget, rest of segment not dissected");
+    } else {
+        expert_add_info_format(pinfo, mc_item, PI_MALFORMED, PI_WARN,
+                               "Oversized %s PDU (%d bytes), body not reassembled",
+                               val_to_str(type, packettypenames, "Unknown Type:0x%02x"), len);
+    }
+
+    if (!pinfo->fd->flags.visited) {
+        conv->pending[dir] = 0;
+        conv->skipping[dir] = len != -1 && tcpinfo != NULL;
+        if (conv->skipping[dir]) {
+            conv->skip_end[dir] = tcpinfo->nxtseq + (len - available);
+        }
+    }
+}
+
+/*
+ * Skip the leading bytes of this segment that still belong to the body of
+ * an oversized PDU.  Returns the offset dissection should start from.
+ * The body is tracked by TCP sequence number rather than by counting
+ * bytes, so retransmitted and out of order segments are skipped by what
+ * they hold, not by when they arrive.
+ */
+static guint skip_oversized_body(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, mc_conv_t *conv, guint dir)
+{
+    struct tcpinfo *tcpinfo = pinfo->private_data;
+    mc_frame_t *frame;
+    proto_item *mc_item;
+    guint32 start;
+    guint skip;
+
+    /* TCP only reassembles from where we asked it to, never inside a body */
+    if (tcpinfo == NULL || tcpinfo->is_reassembled) {
+        return 0;
+    }
+    if (!pinfo->fd->flags.visited) {
+        if (!conv->skipping[dir]) {
+            return 0;
+        }
+        start = tcpinfo->nxtseq - tvb_reported_length(tvb);
+        if ((gint32)(conv->skip_end[dir] - start) <= 0) {
+            if (start - conv->skip_end[dir] > MC_SKIP_WINDOW) {
+                conv->skipping[dir] = FALSE;
+            }
+            return 0;
+        }
+        skip = MIN(conv->skip_end[dir] - start, tvb_reported_length(tvb));
+        frame = get_mc_frame(pinfo, TRUE);
+        frame->skip = skip;
+    } else {
+        frame = get_mc_frame(pinfo, FALSE);
+        skip = frame ? frame->skip : 0;
+    }
+    if (skip == 0) {
+        return 0;
+    }
+
+    if (check_col(pinfo->cinfo, COL_PROTOCOL))
+        col_set_str(pinfo->cinfo, COL_PROTOCOL, PROTO_TAG_MC);
+    if (check_col(pinfo->cinfo, COL_INFO)) {
+        col_add_fstr(pinfo->cinfo, COL_INFO, "Continuation of oversized PDU, %u bytes skipped", skip);
+    }
+    if (tree) {
+        mc_item = proto_tree_add_item(tree, proto_minecraft, tvb, 0, skip, FALSE);
+        PROTO_ITEM_SET_GENERATED(proto_tree_add_uint(proto_item_add_subtree(mc_item, ett_mc),
+                                                     hf_mc_skipped, tvb, 0, skip, skip));
+    }
+    return skip;
+}
+
 #define FRAME_HEADER_LEN 17
 void dissect_minecraft(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
 {
     guint8 packet;
     guint offset=0;
+    conversation_t *conversation;
+    mc_conv_t *conv;
+    mc_frame_t *frame = NULL;
+    mc_tap_info_t *tap;
+    guint dir;
+    gint level, slot;
+    guint32 seq, sampled[MC_SAMPLED_TYPES];
+
+    conversation = find_or_create_conversation(pinfo);
+    conv = get_mc_conv(conversation);
+    dir = pinfo->match_port == pinfo->srcport;
+    tap = new_tap_info(pinfo, conversation);
+    memset(sampled, 0, sizeof(sampled));
+
+    offset = skip_oversized_body(tvb, pinfo, tree, conv, dir);
 
     while (offset < tvb_reported_length(tvb)) {
         packet = tvb_get_guint8(tvb, offset);
         gint available = tvb_reported_length_remaining(tvb, offset);
         gint len = get_minecraft_packet_len(packet, offset, available, tvb);
         if (len == -1 || len > available) {
+            if (is_oversized(tvb, pinfo, conv, dir, packet, offset, len, available)) {
+                dissect_oversized_message(tvb, pinfo, tree, conv, dir, packet, offset, len, available);
+                if (len != -1) {
+                    tap_minecraft_message(tap, tvb, packet, offset, len);
+                }
+                break;
+            }
             pinfo->desegment_offset = offset;
             if ( len == -1 ) {
                 pinfo->desegment_len = DESEGMENT_ONE_MORE_SEGMENT;
             } else {
                 pinfo->desegment_len = len - available;
             }
-            return;
+            if (!pinfo->fd->flags.visited) {
+                conv->pending[dir] = len == -1 ? (guint)available : (guint)len;
+            }
+            break;
+        }
+        level = get_detail_level(packet);
+        seq = 0;
+        if (level == MC_DETAIL_SAMPLED) {
+            slot = get_sample_slot(packet);
+            seq = get_pdu_seq(tvb, pinfo, conv, &frame, slot, sampled[slot]++);
         }
-        dissect_minecraft_message(tvb, pinfo, tree, packet, offset, len);
+        dissect_minecraft_message(tvb, pinfo, tree, packet, offset, len, seq,
+                                  level == MC_DETAIL_FULL ||
+                                  (level == MC_DETAIL_SAMPLED && seq && mc_sample_rate && (seq - 1) % mc_sample_rate == 0));
+        tap_minecraft_message(tap, tvb, packet, offset, len);
         offset += len;
     }
+    if (!pinfo->fd->flags.visited && offset >= tvb_reported_length(tvb)) {
+        conv->pending[dir] = 0;
+    }
+    if (tap && tap->num_pdus) {
+        tap_queue_packet(minecraft_tap, pinfo, tap);
+    }
 }
-
@@ -0,0 +1,102 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef __PACKET_MINECRAFT_H__
+#define __PACKET_MINECRAFT_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* One PDU handed to the "minecraft" tap */
+typedef struct _mc_tap_pdu {
+    guint8 type;
+    guint32 length;
+} mc_tap_pdu_t;
+
+/* A Pre-Chunk or Map Chunk, or the chunk the player is in for Player
+   Position and Player Move + Look */
+typedef struct _mc_tap_chunk {
+    guint8 type;
+    gint32 chunk_x;
+    gint32 chunk_z;
+    gboolean load;          /* Pre-Chunk mode */
+    guint8 size_x;          /* Map Chunk size - 1, 15/127/15 for a whole chunk */
+    guint8 size_y;
+    guint8 size_z;
+} mc_tap_chunk_t;
+
+/*
+ * Queued to the "minecraft" tap once for every tvb the dissector is
+ * handed, with the PDUs found in it in order.  That's once per frame, or
+ * twice when TCP hands over a reassembled PDU and then the rest of the
+ * segment.  epan only queues TAP_PACKET_QUEUE_LEN (100) tap packets per
+ * frame and a full segment of entity moves holds more PDUs than that, so
+ * they can't be queued one by one.  The arrays are ep_alloc'd.
+ */
+typedef struct _mc_tap_info {
+    gboolean from_server;
+    guint32 conv_index;
+    guint16 server_port;
+    guint16 client_port;
+    guint num_pdus;
+    guint max_pdus;
+    mc_tap_pdu_t *pdus;
+    guint num_chunks;
+    guint max_chunks;
+    mc_tap_chunk_t *chunks;
+} mc_tap_info_t;
+
+/* Helpers shared by the taps */
+
+static inline guint64 mc_ts_diff_us(const nstime_t *from, const nstime_t *to)
+{
+    gint64 us;
+
+    us = (gint64)(to->secs - from->secs) * 1000000 + (to->nsecs - from->nsecs) / 1000;
+    return us > 0 ? (guint64)us : 0;
+}
+
+static inline int mc_compare_guint64(const void *a, const void *b)
+{
+    guint64 x = *(const guint64 *)a, y = *(const guint64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Prints p50/p90/p99/max of n values, sorting them in place */
+static inline void mc_print_percentiles(const char *name, guint64 *vals, guint n)
+{
+    if (n == 0) {
+        printf("  %-20s none\n", name);
+        return;
+    }
+    qsort(vals, n, sizeof(guint64), mc_compare_guint64);
+    printf("  %-20s p50 %10" G_GINT64_MODIFIER "u  p90 %10" G_GINT64_MODIFIER "u  p99 %10" G_GINT64_MODIFIER "u  max %10" G_GINT64_MODIFIER "u\n",
+           name, vals[(n - 1) * 50 / 100], vals[(n - 1) * 90 / 100], vals[(n - 1) * 99 / 100], vals[n - 1]);
+}
+
+/* tap-minecraft-ticks.c */
+void register_tap_listener_minecraft_ticks(void);
+
+/* tap-minecraft-chunks.c */
+void register_tap_listener_minecraft_chunks(void);
+
+#endif
@@ -0,0 +1,398 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * tshark -z minecraft,chunks[,csv file[,filter]]
+ *
+ * Follows chunk streaming in every conversation and reports
+ *
+ *  - load to data: the time from a Pre-Chunk (0x32) load to the first
+ *    Map Chunk (0x33) for that chunk,
+ *  - enter to data: the time from a Player Position or Player Move +
+ *    Look (0x0B, 0x0D) putting the player in a chunk that has no data
+ *    yet to the arrival of that data, i.e. how long the player looked
+ *    into the void,
+ *  - the in flight queue: chunks that were loaded but have no data yet,
+ *    its maximum and its mean over time.
+ *
+ * Map Chunks are matched by their block coordinates >> 4.  Only one
+ * covering the whole chunk (16x128x16) is the chunk's data; smaller ones
+ * update blocks the client already has and are ignored, as is a whole
+ * chunk sent again for a chunk that has its data.
+ *
+ * Everything is worked out as the packets go by.  With a file name each
+ * load, unload, data and chunk change of the player is also written to
+ * it as a CSV line when it happens:
+ *
+ *   conversation,frame,time,event,chunk_x,chunk_z,load_to_data_us,enter_to_data_us,in_flight
+ *
+ * The latency columns are empty when they don't apply.  Use ",," to get
+ * the summary only and still pass a filter.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_cmd_args.h>
+
+#include "packet-minecraft.h"
+
+#define MC_PRE_CHUNK 0x32
+#define MC_MAP_CHUNK 0x33
+
+#define MC_CHUNK_PREALLOC 0x01  /* loaded, waiting for data */
+#define MC_CHUNK_LOADED   0x02  /* has data */
+#define MC_CHUNK_WAITING  0x04  /* the player went in before the data */
+
+typedef struct _mc_chunk {
+    gint32 x;
+    gint32 z;
+    guint flags;
+    nstime_t load_ts;
+    nstime_t enter_ts;
+} mc_chunk_t;
+
+typedef struct _mc_chunk_conv {
+    guint32 conv_index;
+    guint16 server_port;
+    guint16 client_port;
+    GHashTable *chunks;
+    gboolean has_pos;
+    gint32 pos_x;
+    gint32 pos_z;
+    guint32 in_flight;
+    guint32 max_in_flight;
+    gboolean has_ts;
+    nstime_t first_ts;
+    nstime_t last_ts;
+    gdouble in_flight_area;     /* chunks in flight * seconds */
+    guint64 loads;
+    guint64 unloaded_in_flight;
+    guint64 entries;
+    guint64 void_entries;
+    GArray *load_to_data;
+    GArray *enter_to_data;
+} mc_chunk_conv_t;
+
+typedef struct _mc_chunks {
+    char *filter;
+    char *csv_name;
+    FILE *csv;
+    GHashTable *convs;
+} mc_chunks_t;
+
+static guint chunk_hash(gconstpointer key)
+{
+    const mc_chunk_t *chunk = key;
+
+    return (guint)chunk->x * 31 + (guint)chunk->z;
+}
+
+static gboolean chunk_equal(gconstpointer a, gconstpointer b)
+{
+    const mc_chunk_t *c1 = a, *c2 = b;
+
+    return c1->x == c2->x && c1->z == c2->z;
+}
+
+static void free_conv(gpointer key _U_, gpointer value, gpointer user_data _U_)
+{
+    mc_chunk_conv_t *conv = value;
+
+    g_hash_table_destroy(conv->chunks);
+    g_array_free(conv->load_to_data, TRUE);
+    g_array_free(conv->enter_to_data, TRUE);
+    g_free(conv);
+}
+
+static void open_csv(mc_chunks_t *mc)
+{
+    if (mc->csv) {
+        fclose(mc->csv);
+    }
+    mc->csv = fopen(mc->csv_name, "w");
+    if (mc->csv == NULL) {
+        fprintf(stderr, "tshark: Couldn't open %s for the minecraft,chunks tap\n", mc->csv_name);
+        return;
+    }
+    fprintf(mc->csv, "conversation,frame,time,event,chunk_x,chunk_z,load_to_data_us,enter_to_data_us,in_flight\n");
+}
+
+static void mc_chunks_reset(void *tapdata)
+{
+    mc_chunks_t *mc = tapdata;
+
+    g_hash_table_foreach(mc->convs, free_conv, NULL);
+    g_hash_table_destroy(mc->convs);
+    mc->convs = g_hash_table_new(g_direct_hash, g_direct_equal);
+    if (mc->csv_name) {
+        open_csv(mc);
+    }
+}
+
+static void write_csv(mc_chunks_t *mc, const mc_chunk_conv_t *conv, const packet_info *pinfo,
+                      const char *event, const mc_chunk_t *chunk, const guint64 *load_us, const guint64 *enter_us)
+{
+    if (mc->csv == NULL) {
+        return;
+    }
+    fprintf(mc->csv, "%u,%u,%ld.%06d,%s,%d,%d,", conv->conv_index, pinfo->fd->num,
+            (long)pinfo->fd->abs_ts.secs, pinfo->fd->abs_ts.nsecs / 1000, event, chunk->x, chunk->z);
+    if (load_us) {
+        fprintf(mc->csv, "%" G_GINT64_MODIFIER "u", *load_us);
+    }
+    fputc(',', mc->csv);
+    if (enter_us) {
+        fprintf(mc->csv, "%" G_GINT64_MODIFIER "u", *enter_us);
+    }
+    fprintf(mc->csv, ",%u\n", conv->in_flight);
+}
+
+static mc_chunk_conv_t *get_conv(mc_chunks_t *mc, const mc_tap_info_t *info)
+{
+    mc_chunk_conv_t *conv;
+
+    conv = g_hash_table_lookup(mc->convs, GUINT_TO_POINTER(info->conv_index));
+    if (conv == NULL) {
+        conv = g_new0(mc_chunk_conv_t, 1);
+        conv->conv_index = info->conv_index;
+        conv->server_port = info->server_port;
+        conv->client_port = info->client_port;
+        conv->chunks = g_hash_table_new_full(chunk_hash, chunk_equal, NULL, g_free);
+        conv->load_to_data = g_array_new(FALSE, FALSE, sizeof(guint64));
+        conv->enter_to_data = g_array_new(FALSE, FALSE, sizeof(guint64));
+        g_hash_table_insert(mc->convs, GUINT_TO_POINTER(info->conv_index), conv);
+    }
+    return conv;
+}
+
+static mc_chunk_t *get_chunk(mc_chunk_conv_t *conv, gint32 x, gint32 z)
+{
+    mc_chunk_t key, *chunk;
+
+    key.x = x;
+    key.z = z;
+    chunk = g_hash_table_lookup(conv->chunks, &key);
+    if (chunk == NULL) {
+        chunk = g_new0(mc_chunk_t, 1);
+        chunk->x = x;
+        chunk->z = z;
+        g_hash_table_insert(conv->chunks, chunk, chunk);
+    }
+    return chunk;
+}
+
+static void chunk_event(mc_chunks_t *mc, mc_chunk_conv_t *conv, const packet_info *pinfo, const mc_tap_chunk_t *event)
+{
+    const nstime_t *ts = &pinfo->fd->abs_ts;
+    mc_chunk_t *chunk;
+    guint64 load_us, enter_us;
+
+    /* the queue depth only changes at the events below */
+    if (!conv->has_ts) {
+        conv->has_ts = TRUE;
+        conv->first_ts = *ts;
+    } else {
+        conv->in_flight_area += conv->in_flight * mc_ts_diff_us(&conv->last_ts, ts) / 1000000.0;
+    }
+    conv->last_ts = *ts;
+
+    switch (event->type) {
+    case MC_PRE_CHUNK:
+        chunk = get_chunk(conv, event->chunk_x, event->chunk_z);
+        if (event->load) {
+            conv->loads++;
+            if (!(chunk->flags & MC_CHUNK_PREALLOC)) {
+                chunk->flags = (chunk->flags & MC_CHUNK_WAITING) | MC_CHUNK_PREALLOC;
+                chunk->load_ts = *ts;
+                conv->in_flight++;
+                if (conv->in_flight > conv->max_in_flight) {
+                    conv->max_in_flight = conv->in_flight;
+                }
+            }
+            write_csv(mc, conv, pinfo, "load", chunk, NULL, NULL);
+        } else {
+            if (chunk->flags & MC_CHUNK_PREALLOC) {
+                conv->in_flight--;
+                conv->unloaded_in_flight++;
+            }
+            chunk->flags = 0;
+            write_csv(mc, conv, pinfo, "unload", chunk, NULL, NULL);
+            g_hash_table_remove(conv->chunks, chunk);
+        }
+        break;
+
+    case MC_MAP_CHUNK:
+        if (event->size_x != 15 || event->size_y != 127 || event->size_z != 15) {
+            return;
+        }
+        chunk = get_chunk(conv, event->chunk_x, event->chunk_z);
+        if ((chunk->flags & MC_CHUNK_LOADED) && !(chunk->flags & MC_CHUNK_PREALLOC)) {
+            return;
+        }
+        if (chunk->flags & MC_CHUNK_PREALLOC) {
+            load_us = mc_ts_diff_us(&chunk->load_ts, ts);
+            g_array_append_val(conv->load_to_data, load_us);
+            conv->in_flight--;
+        }
+        if (chunk->flags & MC_CHUNK_WAITING) {
+            enter_us = mc_ts_diff_us(&chunk->enter_ts, ts);
+            g_array_append_val(conv->enter_to_data, enter_us);
+        }
+        write_csv(mc, conv, pinfo, "data", chunk,
+                  chunk->flags & MC_CHUNK_PREALLOC ? &load_us : NULL,
+                  chunk->flags & MC_CHUNK_WAITING ? &enter_us : NULL);
+        chunk->flags = MC_CHUNK_LOADED;
+        break;
+
+    default:
+        if (conv->has_pos && conv->pos_x == event->chunk_x && conv->pos_z == event->chunk_z) {
+            return;
+        }
+        conv->has_pos = TRUE;
+        conv->pos_x = event->chunk_x;
+        conv->pos_z = event->chunk_z;
+        conv->entries++;
+        chunk = get_chunk(conv, event->chunk_x, event->chunk_z);
+        if (!(chunk->flags & MC_CHUNK_LOADED)) {
+            conv->void_entries++;
+            if (!(chunk->flags & MC_CHUNK_WAITING)) {
+                chunk->flags |= MC_CHUNK_WAITING;
+                chunk->enter_ts = *ts;
+            }
+        }
+        write_csv(mc, conv, pinfo, "enter", chunk, NULL, NULL);
+        break;
+    }
+}
+
+static int mc_chunks_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data)
+{
+    mc_chunks_t *mc = tapdata;
+    const mc_tap_info_t *info = data;
+    mc_chunk_conv_t *conv;
+    guint i;
+
+    if (info->num_chunks == 0) {
+        return 0;
+    }
+    conv = get_conv(mc, info);
+    for (i = 0; i < info->num_chunks; i++) {
+        chunk_event(mc, conv, pinfo, &info->chunks[i]);
+    }
+    return 1;
+}
+
+static void count_waiting(gpointer key _U_, gpointer value, gpointer user_data)
+{
+    const mc_chunk_t *chunk = value;
+
+    if (chunk->flags & MC_CHUNK_WAITING) {
+        (*(guint *)user_data)++;
+    }
+}
+
+static void draw_conv(gpointer key _U_, gpointer value, gpointer user_data _U_)
+{
+    mc_chunk_conv_t *conv = value;
+    gdouble duration;
+    guint waiting = 0;
+
+    duration = mc_ts_diff_us(&conv->first_ts, &conv->last_ts) / 1000000.0;
+    g_hash_table_foreach(conv->chunks, count_waiting, &waiting);
+
+    printf("\nConversation %u, server port %u -> client port %u\n",
+           conv->conv_index, conv->server_port, conv->client_port);
+    printf("  Pre-Chunk loads %" G_GINT64_MODIFIER "u, with data %u, unloaded before data %" G_GINT64_MODIFIER "u, still in flight %u\n",
+           conv->loads, conv->load_to_data->len, conv->unloaded_in_flight, conv->in_flight);
+    printf("  In flight: max %u, mean %.2f\n",
+           conv->max_in_flight, duration > 0 ? conv->in_flight_area / duration : 0.0);
+    printf("  Chunk changes %" G_GINT64_MODIFIER "u, into chunks without data %" G_GINT64_MODIFIER "u, never got data %u\n",
+           conv->entries, conv->void_entries, waiting);
+    mc_print_percentiles("Load to data(us)", (guint64 *)conv->load_to_data->data, conv->load_to_data->len);
+    mc_print_percentiles("Enter to data(us)", (guint64 *)conv->enter_to_data->data, conv->enter_to_data->len);
+}
+
+static void mc_chunks_draw(void *tapdata)
+{
+    mc_chunks_t *mc = tapdata;
+
+    if (mc->csv) {
+        fflush(mc->csv);
+    }
+    printf("\n");
+    printf("===================================================================\n");
+    printf("Minecraft Chunk Streaming\n");
+    printf("Filter: %s\n", mc->filter ? mc->filter : "");
+    g_hash_table_foreach(mc->convs, draw_conv, NULL);
+    printf("===================================================================\n");
+}
+
+static void mc_chunks_init(const char *optarg, void *userdata _U_)
+{
+    mc_chunks_t *mc;
+    const char *arg, *comma;
+    GString *error_string;
+
+    mc = g_new0(mc_chunks_t, 1);
+    if (!strncmp(optarg, "minecraft,chunks,", 17)) {
+        arg = optarg + 17;
+        comma = strchr(arg, ',');
+        if (comma) {
+            mc->csv_name = g_strndup(arg, comma - arg);
+            mc->filter = g_strdup(comma + 1);
+        } else {
+            mc->csv_name = g_strdup(arg);
+        }
+        if (*mc->csv_name == '\0') {
+            g_free(mc->csv_name);
+            mc->csv_name = NULL;
+        }
+    }
+    mc->convs = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    error_string = register_tap_listener("minecraft", mc, mc->filter, 0,
+                                         mc_chunks_reset, mc_chunks_packet, mc_chunks_draw);
+    if (error_string) {
+        fprintf(stderr, "tshark: Couldn't register minecraft,chunks tap: %s\n", error_string->str);
+        g_string_free(error_string, TRUE);
+        g_free(mc->filter);
+        g_free(mc->csv_name);
+        g_hash_table_destroy(mc->convs);
+        g_free(mc);
+        exit(1);
+    }
+    if (mc->csv_name) {
+        open_csv(mc);
+    }
+}
+
+void register_tap_listener_minecraft_chunks(void)
+{
+    register_stat_cmd_arg("minecraft,chunks", mc_chunks_init, NULL);
+}
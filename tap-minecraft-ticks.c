@@ -0,0 +1,323 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * tshark -z minecraft,ticks[,filter]
+ *
+ * Splits every server to client stream into ticks at each Update Time
+ * (0x04) and reports, per tick, how many PDUs and bytes were sent, the
+ * opcode mix, how many TCP segments carried them and how long it took
+ * from the first segment to the last.  Percentiles over the whole
+ * session are printed after the per tick lines.
+ *
+ * A segment belongs to the ticks of the PDUs that end in it.  TCP only
+ * hands the Minecraft dissector a segment from the middle of a large
+ * reassembled PDU (a Map Chunk, usually) once the PDU is complete, so
+ * the "tcp" tap is followed as well and a segment in which no PDU ends
+ * is counted in the tick that is open when it arrives.  PDUs sent
+ * before the first Update Time of a stream do not belong to any tick
+ * and are ignored.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epan/packet.h>
+#include <epan/conversation.h>
+#include <epan/tap.h>
+#include <epan/stat_cmd_args.h>
+#include <epan/dissectors/packet-tcp.h>
+
+#include "packet-minecraft.h"
+
+#define MC_TICK_TIME 0x04
+
+/* One finished tick */
+typedef struct _mc_tick {
+    guint32 first_frame;
+    guint64 pdus;
+    guint64 bytes;
+    guint64 segments;
+    guint64 duration_us;
+    gchar *mix;
+} mc_tick_t;
+
+/* Server to client stream of one conversation */
+typedef struct _mc_tick_stream {
+    guint32 conv_index;
+    guint16 server_port;
+    guint16 client_port;
+    gboolean in_tick;
+    mc_tick_t cur;
+    guint32 last_frame;     /* last segment counted in cur */
+    nstime_t first_ts;
+    nstime_t last_ts;
+    guint32 mix[256];
+    GArray *ticks;
+    guint32 pdu_frame;      /* last frame with PDUs of this stream */
+    guint32 seg_frame;      /* segment seen by the tcp tap alone so far */
+    nstime_t seg_ts;
+} mc_tick_stream_t;
+
+typedef struct _mc_ticks {
+    char *filter;
+    GHashTable *streams;
+} mc_ticks_t;
+
+static void close_tick(mc_tick_stream_t *stream)
+{
+    GString *mix;
+    guint i;
+
+    if (!stream->in_tick) {
+        return;
+    }
+    mix = g_string_new("");
+    for (i = 0; i < 256; i++) {
+        if (stream->mix[i]) {
+            g_string_append_printf(mix, "%s0x%02x:%u", mix->len ? " " : "", i, stream->mix[i]);
+        }
+    }
+    stream->cur.duration_us = mc_ts_diff_us(&stream->first_ts, &stream->last_ts);
+    stream->cur.mix = g_string_free(mix, FALSE);
+    g_array_append_val(stream->ticks, stream->cur);
+    stream->in_tick = FALSE;
+}
+
+static void free_stream(gpointer key _U_, gpointer value, gpointer user_data _U_)
+{
+    mc_tick_stream_t *stream = value;
+    guint i;
+
+    for (i = 0; i < stream->ticks->len; i++) {
+        g_free(g_array_index(stream->ticks, mc_tick_t, i).mix);
+    }
+    g_array_free(stream->ticks, TRUE);
+    g_free(stream);
+}
+
+static void mc_ticks_reset(void *tapdata)
+{
+    mc_ticks_t *mt = tapdata;
+
+    g_hash_table_foreach(mt->streams, free_stream, NULL);
+    g_hash_table_destroy(mt->streams);
+    mt->streams = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+static void count_segment(mc_tick_stream_t *stream, guint32 frame, const nstime_t *ts)
+{
+    if (!stream->in_tick) {
+        return;
+    }
+    if (frame != stream->last_frame) {
+        stream->cur.segments++;
+        stream->last_frame = frame;
+    }
+    stream->last_ts = *ts;
+}
+
+/* A segment the tcp tap saw and no PDU ended in belongs to the open tick */
+static void flush_segment(mc_tick_stream_t *stream, guint32 frame)
+{
+    if (stream->seg_frame && stream->seg_frame != frame) {
+        count_segment(stream, stream->seg_frame, &stream->seg_ts);
+        stream->seg_frame = 0;
+    }
+}
+
+static int mc_ticks_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data)
+{
+    mc_ticks_t *mt = tapdata;
+    const mc_tap_info_t *info = data;
+    mc_tick_stream_t *stream;
+    const mc_tap_pdu_t *pdu;
+    guint i;
+
+    if (!info->from_server) {
+        return 0;
+    }
+
+    stream = g_hash_table_lookup(mt->streams, GUINT_TO_POINTER(info->conv_index));
+    if (stream == NULL) {
+        stream = g_new0(mc_tick_stream_t, 1);
+        stream->conv_index = info->conv_index;
+        stream->server_port = info->server_port;
+        stream->client_port = info->client_port;
+        stream->ticks = g_array_new(FALSE, FALSE, sizeof(mc_tick_t));
+        g_hash_table_insert(mt->streams, GUINT_TO_POINTER(info->conv_index), stream);
+    }
+
+    /* this frame's segment is counted with its PDUs below */
+    flush_segment(stream, pinfo->fd->num);
+    stream->seg_frame = 0;
+    stream->pdu_frame = pinfo->fd->num;
+
+    for (i = 0; i < info->num_pdus; i++) {
+        pdu = &info->pdus[i];
+        if (pdu->type == MC_TICK_TIME) {
+            close_tick(stream);
+            memset(&stream->cur, 0, sizeof(stream->cur));
+            memset(stream->mix, 0, sizeof(stream->mix));
+            stream->cur.first_frame = pinfo->fd->num;
+            stream->first_ts = pinfo->fd->abs_ts;
+            stream->last_frame = 0;
+            stream->in_tick = TRUE;
+        }
+        if (!stream->in_tick) {
+            continue;
+        }
+        stream->cur.pdus++;
+        stream->cur.bytes += pdu->length;
+        stream->mix[pdu->type]++;
+        count_segment(stream, pinfo->fd->num, &pinfo->fd->abs_ts);
+    }
+    return 1;
+}
+
+/*
+ * Every server to client segment with data.  Whether a Minecraft PDU
+ * ends in it is only known once its frame's "minecraft" tap packet has
+ * been seen, which may be before or after this one, so it's held back
+ * until then.
+ */
+static int mc_ticks_tcp_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data)
+{
+    mc_ticks_t *mt = tapdata;
+    const struct tcpheader *tcph = data;
+    conversation_t *conversation;
+    mc_tick_stream_t *stream;
+
+    if (!tcph->th_have_seglen || tcph->th_seglen == 0) {
+        return 0;
+    }
+    conversation = find_conversation(pinfo->fd->num, &tcph->ip_src, &tcph->ip_dst, PT_TCP,
+                                     tcph->th_sport, tcph->th_dport, 0);
+    if (conversation == NULL) {
+        return 0;
+    }
+    stream = g_hash_table_lookup(mt->streams, GUINT_TO_POINTER(conversation->index));
+    if (stream == NULL || tcph->th_sport != stream->server_port) {
+        return 0;
+    }
+    flush_segment(stream, pinfo->fd->num);
+    if (stream->pdu_frame != pinfo->fd->num) {
+        stream->seg_frame = pinfo->fd->num;
+        stream->seg_ts = pinfo->fd->abs_ts;
+    }
+    return 1;
+}
+
+/* Prints p50/p90/p99/max of one column of the tick table */
+static void print_percentiles(const char *name, GArray *ticks, glong field)
+{
+    guint64 *vals;
+    guint i, n = ticks->len;
+
+    vals = g_new(guint64, n);
+    for (i = 0; i < n; i++) {
+        vals[i] = G_STRUCT_MEMBER(guint64, &g_array_index(ticks, mc_tick_t, i), field);
+    }
+    mc_print_percentiles(name, vals, n);
+    g_free(vals);
+}
+
+static void draw_stream(gpointer key _U_, gpointer value, gpointer user_data _U_)
+{
+    mc_tick_stream_t *stream = value;
+    guint i;
+
+    flush_segment(stream, 0);
+    close_tick(stream);
+
+    printf("\nConversation %u, server port %u -> client port %u: %u ticks\n",
+           stream->conv_index, stream->server_port, stream->client_port, stream->ticks->len);
+    if (stream->ticks->len == 0) {
+        return;
+    }
+    printf("  %8s %8s %10s %8s %12s  %s\n", "Frame", "PDUs", "Bytes", "Segments", "Duration(us)", "Opcodes");
+    for (i = 0; i < stream->ticks->len; i++) {
+        mc_tick_t *tick = &g_array_index(stream->ticks, mc_tick_t, i);
+
+        printf("  %8u %8" G_GINT64_MODIFIER "u %10" G_GINT64_MODIFIER "u %8" G_GINT64_MODIFIER "u %12" G_GINT64_MODIFIER "u  %s\n",
+               tick->first_frame, tick->pdus, tick->bytes, tick->segments, tick->duration_us, tick->mix);
+    }
+    printf("\n");
+    print_percentiles("PDUs", stream->ticks, G_STRUCT_OFFSET(mc_tick_t, pdus));
+    print_percentiles("Bytes", stream->ticks, G_STRUCT_OFFSET(mc_tick_t, bytes));
+    print_percentiles("Segments", stream->ticks, G_STRUCT_OFFSET(mc_tick_t, segments));
+    print_percentiles("Duration(us)", stream->ticks, G_STRUCT_OFFSET(mc_tick_t, duration_us));
+}
+
+static void mc_ticks_draw(void *tapdata)
+{
+    mc_ticks_t *mt = tapdata;
+
+    printf("\n");
+    printf("===================================================================\n");
+    printf("Minecraft Server Ticks\n");
+    printf("Filter: %s\n", mt->filter ? mt->filter : "");
+    g_hash_table_foreach(mt->streams, draw_stream, NULL);
+    printf("===================================================================\n");
+}
+
+static void mc_ticks_init(const char *optarg, void *userdata _U_)
+{
+    mc_ticks_t *mt;
+    const char *filter = NULL;
+    GString *error_string;
+
+    if (!strncmp(optarg, "minecraft,ticks,", 16)) {
+        filter = optarg + 16;
+    }
+
+    mt = g_new0(mc_ticks_t, 1);
+    mt->filter = filter ? g_strdup(filter) : NULL;
+    mt->streams = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    error_string = register_tap_listener("minecraft", mt, mt->filter, 0,
+                                         mc_ticks_reset, mc_ticks_packet, mc_ticks_draw);
+    if (error_string) {
+        fprintf(stderr, "tshark: Couldn't register minecraft,ticks tap: %s\n", error_string->str);
+        g_string_free(error_string, TRUE);
+        g_free(mt->filter);
+        g_hash_table_destroy(mt->streams);
+        g_free(mt);
+        exit(1);
+    }
+    error_string = register_tap_listener("tcp", mt, mt->filter, 0,
+                                         NULL, mc_ticks_tcp_packet, NULL);
+    if (error_string) {
+        fprintf(stderr, "tshark: Couldn't register minecraft,ticks tap: %s\n", error_string->str);
+        g_string_free(error_string, TRUE);
+        exit(1);
+    }
+}
+
+void register_tap_listener_minecraft_ticks(void)
+{
+    register_stat_cmd_arg("minecraft,ticks", mc_ticks_init, NULL);
+}
@@ -0,0 +1 @@
+#include "../../stub-epan.h"
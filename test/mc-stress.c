@@ -0,0 +1,782 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * Concurrency stress test for the dissector.
+ *
+ * A set of synthetic sessions is dissected one after the other, then
+ * again with every session on its own thread, several times over; the
+ * rendered trees have to come out byte for byte the same.  Each session
+ * is dissected the way Wireshark 1.x does it: a first pass without a
+ * tree, with TCP reassembling whatever the dissector asks for, then a
+ * second pass over the same calls with a tree.  The numbering of sampled
+ * PDUs is checked along the way.
+ *
+ *   mc-stress [flows [threads [rounds]]]
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "stub-epan.h"
+
+void proto_register_minecraft(void);
+void proto_reg_handoff_minecraft(void);
+void dissect_minecraft(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree);
+
+#define SERVER_PORT 25565
+#define HEADER_LEN  54      /* Ethernet, IPv4 and TCP in front of the payload */
+#define MAX_SEGMENT 1460
+
+typedef struct {
+    guint8 *data;
+    guint len;
+    guint size;
+} buf_t;
+
+typedef struct {
+    frame_data fd;
+    guint dir;              /* 1 is server to client */
+    guint32 seq;
+    const guint8 *payload;
+    guint len;
+} frame_t;
+
+/* One call TCP made into the dissector, replayed on the second pass */
+typedef struct {
+    guint frame;
+    const guint8 *data;
+    guint len;
+    gint raw_offset;
+    struct tcpinfo tcp;
+} call_t;
+
+/* A PDU TCP is reassembling */
+typedef struct {
+    gboolean active;
+    gboolean one_more;
+    guint32 seq;
+    guint32 end;
+    buf_t held;
+} msp_t;
+
+typedef struct {
+    guint16 client_port;
+    buf_t stream[2];
+    frame_t *frames;
+    guint num_frames;
+    guint frames_size;
+    call_t *calls;
+    guint num_calls;
+    guint calls_size;
+    GSList *reassembled;    /* buffers the calls point into */
+    GString *out;
+} flow_t;
+
+static flow_t *flows;
+static guint num_flows = 32;
+static volatile guint next_flow;
+
+/* ---- building the sessions ---- */
+
+static guint32 rng_next(guint32 *state)
+{
+    guint32 x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static guint32 rng_range(guint32 *state, guint32 lo, guint32 hi)
+{
+    return lo + rng_next(state) % (hi - lo + 1);
+}
+
+static void buf_put(buf_t *b, const void *p, guint len)
+{
+    if (b->len + len > b->size) {
+        b->size = MAX(b->size * 2, b->len + len + 256);
+        b->data = g_realloc(b->data, b->size);
+    }
+    memcpy(b->data + b->len, p, len);
+    b->len += len;
+}
+
+static void put8(buf_t *b, guint8 v)
+{
+    buf_put(b, &v, 1);
+}
+
+static void put16(buf_t *b, guint16 v)
+{
+    guint8 p[2] = { v >> 8, v };
+
+    buf_put(b, p, 2);
+}
+
+static void put32(buf_t *b, guint32 v)
+{
+    put16(b, v >> 16);
+    put16(b, v);
+}
+
+static void put64(buf_t *b, guint64 v)
+{
+    put32(b, v >> 32);
+    put32(b, v);
+}
+
+static void put_double(buf_t *b, gdouble d)
+{
+    guint64 v;
+
+    memcpy(&v, &d, sizeof(v));
+    put64(b, v);
+}
+
+static void put_float(buf_t *b, gfloat f)
+{
+    guint32 v;
+
+    memcpy(&v, &f, sizeof(v));
+    put32(b, v);
+}
+
+static void put_string(buf_t *b, const char *s)
+{
+    put16(b, strlen(s));
+    buf_put(b, s, strlen(s));
+}
+
+static void put_random(buf_t *b, guint32 *rng, guint len)
+{
+    while (len--) {
+        put8(b, rng_next(rng));
+    }
+}
+
+/* A gzip'd tile entity, as found in a Complex Entity body */
+static void put_nbt(buf_t *b, guint32 *rng)
+{
+    buf_t nbt = { NULL, 0, 0 };
+    z_stream strm;
+    guint8 out[4096];
+    guint i, items;
+
+    put8(&nbt, 10);
+    put_string(&nbt, "");
+    put8(&nbt, 8);
+    put_string(&nbt, "id");
+    put_string(&nbt, "Chest");
+    put8(&nbt, 3);
+    put_string(&nbt, "x");
+    put32(&nbt, rng_next(rng));
+    put8(&nbt, 4);
+    put_string(&nbt, "seed");
+    put64(&nbt, (guint64)rng_next(rng) << 32 | rng_next(rng));
+    put8(&nbt, 9);
+    put_string(&nbt, "Items");
+    items = rng_range(rng, 0, 27);
+    put8(&nbt, 10);
+    put32(&nbt, items);
+    for (i = 0; i < items; i++) {
+        put8(&nbt, 1);
+        put_string(&nbt, "Slot");
+        put8(&nbt, i);
+        put8(&nbt, 2);
+        put_string(&nbt, "id");
+        put16(&nbt, rng_range(rng, 1, 400));
+        put8(&nbt, 5);
+        put_string(&nbt, "f");
+        put_float(&nbt, (gfloat)rng_next(rng) / 7);
+        put8(&nbt, 0);
+    }
+    put8(&nbt, 7);
+    put_string(&nbt, "data");
+    put32(&nbt, 16);
+    put_random(&nbt, rng, 16);
+    put8(&nbt, 0);
+
+    memset(&strm, 0, sizeof(strm));
+    deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+    strm.next_in = nbt.data;
+    strm.avail_in = nbt.len;
+    strm.next_out = out;
+    strm.avail_out = sizeof(out);
+    deflate(&strm, Z_FINISH);
+    deflateEnd(&strm);
+    g_free(nbt.data);
+
+    put16(b, strm.total_out);
+    buf_put(b, out, strm.total_out);
+}
+
+static void put_client_pdu(buf_t *b, guint32 *rng)
+{
+    switch (rng_range(rng, 0, 9)) {
+    case 0:
+        put8(b, 0x00);
+        break;
+    case 1:
+        put8(b, 0x03);
+        put_string(b, "hello there");
+        break;
+    case 2:
+    case 3:
+        put8(b, 0x0A);
+        put8(b, 1);
+        break;
+    case 4:
+    case 5:
+        put8(b, 0x0B);
+        put_double(b, (gdouble)rng_range(rng, 0, 4000) - 2000.5);
+        put_double(b, 64.0);
+        put_double(b, 65.62);
+        put_double(b, (gdouble)rng_range(rng, 0, 4000) - 2000.25);
+        put8(b, 1);
+        break;
+    case 6:
+        put8(b, 0x0C);
+        put_float(b, 90.0);
+        put_float(b, -12.5);
+        put8(b, 0);
+        break;
+    default:
+        put8(b, 0x0D);
+        put_double(b, (gdouble)rng_range(rng, 0, 4000) - 2000.5);
+        put_double(b, 64.0);
+        put_double(b, 65.62);
+        put_double(b, (gdouble)rng_range(rng, 0, 4000) - 2000.25);
+        put_float(b, 180.0);
+        put_float(b, 0.5);
+        put8(b, 1);
+        break;
+    }
+}
+
+static void put_server_pdu(buf_t *b, guint32 *rng)
+{
+    guint n;
+
+    switch (rng_range(rng, 0, 19)) {
+    case 0:
+        put8(b, 0x04);
+        put64(b, rng_next(rng));
+        break;
+    case 1:
+        put8(b, 0x32);
+        put32(b, rng_range(rng, 0, 100) - 50);
+        put32(b, rng_range(rng, 0, 100) - 50);
+        put8(b, rng_next(rng) & 1);
+        break;
+    case 2:
+        /* mostly small, now and then over the Map Chunk limit */
+        n = rng_range(rng, 0, 15) ? rng_range(rng, 100, 6000) : rng_range(rng, 70000, 200000);
+        put8(b, 0x33);
+        put32(b, (rng_range(rng, 0, 100) - 50) * 16);
+        put16(b, 0);
+        put32(b, (rng_range(rng, 0, 100) - 50) * 16);
+        put8(b, 15);
+        put8(b, 127);
+        put8(b, 15);
+        put32(b, n);
+        put_random(b, rng, n);
+        break;
+    case 3:
+        n = rng_range(rng, 1, 40);
+        put8(b, 0x34);
+        put32(b, rng_next(rng));
+        put32(b, rng_next(rng));
+        put16(b, n);
+        put_random(b, rng, 4 * n);
+        break;
+    case 4:
+        put8(b, 0x3b);
+        put32(b, rng_next(rng));
+        put16(b, 64);
+        put32(b, rng_next(rng));
+        put_nbt(b, rng);
+        break;
+    case 5:
+        put8(b, 0x03);
+        put_string(b, "<server> welcome to the stress test");
+        break;
+    case 6:
+    case 7:
+    case 8:
+    case 9:
+        put8(b, 0x1F);
+        put32(b, rng_range(rng, 1, 50));
+        put_random(b, rng, 3);
+        break;
+    case 10:
+    case 11:
+    case 12:
+        put8(b, 0x20);
+        put32(b, rng_range(rng, 1, 50));
+        put_random(b, rng, 2);
+        break;
+    case 13:
+    case 14:
+    case 15:
+    case 16:
+        put8(b, 0x21);
+        put32(b, rng_range(rng, 1, 50));
+        put_random(b, rng, 5);
+        break;
+    default:
+        put8(b, 0x00);
+        break;
+    }
+}
+
+static void add_frame(flow_t *flow, guint dir, guint32 seq, const guint8 *payload, guint len)
+{
+    frame_t *frame;
+
+    if (flow->num_frames == flow->frames_size) {
+        flow->frames_size = MAX(flow->frames_size * 2, 256);
+        flow->frames = g_realloc(flow->frames, flow->frames_size * sizeof(frame_t));
+    }
+    frame = &flow->frames[flow->num_frames];
+    memset(frame, 0, sizeof(frame_t));
+    frame->fd.num = flow->num_frames + 1;
+    frame->fd.abs_ts.secs = flow->num_frames / 100;
+    frame->dir = dir;
+    frame->seq = seq;
+    frame->payload = payload;
+    frame->len = len;
+    flow->num_frames++;
+}
+
+static void build_flow(flow_t *flow, guint index)
+{
+    guint32 rng = 0x9e3779b9U * (index + 1);
+    guint32 seq[2];
+    guint sent[2] = { 0, 0 };
+    guint dir, len;
+    guint i, pdus;
+
+    flow->client_port = 40000 + index;
+
+    put8(&flow->stream[0], 0x02);
+    put_string(&flow->stream[0], "player");
+    put8(&flow->stream[0], 0x01);
+    put32(&flow->stream[0], 14);
+    put_string(&flow->stream[0], "player");
+    put_string(&flow->stream[0], "password");
+    put64(&flow->stream[0], 0);
+    put8(&flow->stream[0], 0);
+    put8(&flow->stream[1], 0x02);
+    put_string(&flow->stream[1], "-");
+    put8(&flow->stream[1], 0x01);
+    put32(&flow->stream[1], 1234);
+    put_string(&flow->stream[1], "");
+    put_string(&flow->stream[1], "");
+    put64(&flow->stream[1], 971768181197178410ULL);
+    put8(&flow->stream[1], 0);
+
+    pdus = rng_range(&rng, 1000, 3000);
+    for (i = 0; i < pdus; i++) {
+        put_client_pdu(&flow->stream[0], &rng);
+        put_server_pdu(&flow->stream[1], &rng);
+    }
+
+    /* the first session's sequence numbers wrap part way through */
+    seq[0] = index == 0 ? 0xffffc000U : rng_next(&rng);
+    seq[1] = index == 0 ? 0xfffff000U : rng_next(&rng);
+
+    while (sent[0] < flow->stream[0].len || sent[1] < flow->stream[1].len) {
+        if (sent[0] == flow->stream[0].len) {
+            dir = 1;
+        } else if (sent[1] == flow->stream[1].len) {
+            dir = 0;
+        } else {
+            dir = rng_next(&rng) % 3 != 0;
+        }
+        /* a mix of tiny, odd and full sized segments */
+        switch (rng_range(&rng, 0, 3)) {
+        case 0:
+            len = rng_range(&rng, 1, 40);
+            break;
+        case 1:
+            len = rng_range(&rng, 41, MAX_SEGMENT);
+            break;
+        default:
+            len = MAX_SEGMENT;
+            break;
+        }
+        len = MIN(len, flow->stream[dir].len - sent[dir]);
+
+        add_frame(flow, dir, seq[dir] + sent[dir], flow->stream[dir].data + sent[dir], len);
+        sent[dir] += len;
+    }
+}
+
+/* ---- dissecting them ---- */
+
+static void call_dissector(flow_t *flow, call_t *call, proto_tree *tree, guint *deseg_offset, guint32 *deseg_len)
+{
+    frame_t *frame = &flow->frames[call->frame];
+    struct tcpinfo tcpinfo = call->tcp;
+    packet_info pinfo;
+
+    memset(&pinfo, 0, sizeof(pinfo));
+    pinfo.fd = &frame->fd;
+    pinfo.srcport = frame->dir ? SERVER_PORT : flow->client_port;
+    pinfo.destport = frame->dir ? flow->client_port : SERVER_PORT;
+    pinfo.match_port = SERVER_PORT;
+    pinfo.private_data = &tcpinfo;
+    dissect_minecraft(stub_tvb_new(call->data, call->len, call->raw_offset), &pinfo, tree);
+
+    *deseg_offset = pinfo.desegment_offset;
+    *deseg_len = pinfo.desegment_len;
+}
+
+/*
+ * First pass delivery of data to the dissector, returning whether it
+ * asked for more and if so from which offset and how much.
+ */
+static gboolean deliver(flow_t *flow, guint frame, const guint8 *data, guint len, gint raw_offset,
+                        guint32 seq, gboolean reassembled, guint *deseg_offset, guint32 *deseg_len)
+{
+    call_t *call;
+
+    if (flow->num_calls == flow->calls_size) {
+        flow->calls_size = MAX(flow->calls_size * 2, 256);
+        flow->calls = g_realloc(flow->calls, flow->calls_size * sizeof(call_t));
+    }
+    call = &flow->calls[flow->num_calls++];
+    call->frame = frame;
+    call->data = data;
+    call->len = len;
+    call->raw_offset = raw_offset;
+    call->tcp.seq = seq;
+    call->tcp.nxtseq = seq + len;
+    call->tcp.is_reassembled = reassembled;
+
+    call_dissector(flow, call, NULL, deseg_offset, deseg_len);
+    stub_ep_free_all();
+    return *deseg_len != 0;
+}
+
+static void msp_start(msp_t *msp, guint32 seq, const guint8 *data, guint len, guint32 deseg_len)
+{
+    msp->active = TRUE;
+    msp->seq = seq;
+    msp->one_more = deseg_len == DESEGMENT_ONE_MORE_SEGMENT;
+    msp->end = seq + len + (msp->one_more ? 0 : deseg_len);
+    msp->held.len = 0;
+    buf_put(&msp->held, data, len);
+}
+
+/* Roughly what the 1.x TCP dissector does with an in order segment */
+static void tcp_segment(flow_t *flow, guint frame, msp_t *msp)
+{
+    frame_t *f = &flow->frames[frame];
+    guint pos = 0, take, deseg_offset;
+    guint32 deseg_len;
+    guint8 *pdu;
+    guint pdu_len;
+
+    if (msp->active) {
+        take = msp->one_more ? f->len : MIN(f->len, msp->end - (msp->seq + msp->held.len));
+        buf_put(&msp->held, f->payload, take);
+        pos = take;
+        if (!msp->one_more && msp->seq + msp->held.len != msp->end) {
+            return;
+        }
+        pdu_len = msp->held.len;
+        pdu = g_memdup(msp->held.data, pdu_len);
+        flow->reassembled = g_slist_prepend(flow->reassembled, pdu);
+        msp->active = FALSE;
+        if (deliver(flow, frame, pdu, pdu_len, 0, msp->seq, TRUE, &deseg_offset, &deseg_len)) {
+            msp_start(msp, msp->seq + deseg_offset, pdu + deseg_offset, pdu_len - deseg_offset, deseg_len);
+        }
+    }
+    if (pos < f->len &&
+        deliver(flow, frame, f->payload + pos, f->len - pos, HEADER_LEN + pos, f->seq + pos, FALSE,
+                &deseg_offset, &deseg_len)) {
+        msp_start(msp, f->seq + pos + deseg_offset, f->payload + pos + deseg_offset,
+                  f->len - pos - deseg_offset, deseg_len);
+    }
+}
+
+static void dissect_flow(flow_t *flow)
+{
+    msp_t msp[2];
+    proto_tree *tree;
+    guint i, deseg_offset;
+    guint32 deseg_len;
+
+    flow->num_calls = 0;
+    flow->reassembled = NULL;
+    flow->out = g_string_new("");
+    for (i = 0; i < flow->num_frames; i++) {
+        flow->frames[i].fd.flags.visited = 0;
+        flow->frames[i].fd.proto_data = NULL;
+    }
+
+    memset(msp, 0, sizeof(msp));
+    for (i = 0; i < flow->num_frames; i++) {
+        tcp_segment(flow, i, &msp[flow->frames[i].dir]);
+    }
+    g_free(msp[0].held.data);
+    g_free(msp[1].held.data);
+
+    for (i = 0; i < flow->num_frames; i++) {
+        flow->frames[i].fd.flags.visited = 1;
+    }
+    for (i = 0; i < flow->num_calls; i++) {
+        g_string_append_printf(flow->out, "Frame %u, seq %u, %u bytes%s\n",
+                               flow->frames[flow->calls[i].frame].fd.num, flow->calls[i].tcp.seq,
+                               flow->calls[i].len, flow->calls[i].tcp.is_reassembled ? ", reassembled" : "");
+        tree = stub_tree_new(flow->out);
+        call_dissector(flow, &flow->calls[i], tree, &deseg_offset, &deseg_len);
+        stub_ep_free_all();
+    }
+
+    g_slist_free_full(flow->reassembled, g_free);
+}
+
+static void *dissect_thread(void *arg _U_)
+{
+    guint i;
+
+    while ((i = __sync_fetch_and_add(&next_flow, 1)) < num_flows) {
+        dissect_flow(&flows[i]);
+    }
+    return NULL;
+}
+
+/*
+ * The body of an oversized Map Chunk with one of its segments sent twice
+ * and two others swapped.  Only the PDUs after the body may be dissected.
+ */
+static guint check_skipped_body(void)
+{
+    flow_t flow;
+    buf_t *b;
+    guint32 rng = 1, seq = 0xffff0000U;
+    guint off, len, i, failed = 0;
+    const gchar *line;
+    guint pdus = 0, skipped = 0;
+
+    memset(&flow, 0, sizeof(flow));
+    flow.client_port = 39999;
+    b = &flow.stream[1];
+    put8(b, 0x33);
+    put32(b, 0);
+    put16(b, 0);
+    put32(b, 0);
+    put8(b, 15);
+    put8(b, 127);
+    put8(b, 15);
+    put32(b, 100000);
+    put_random(b, &rng, 100000);
+    put8(b, 0x00);
+    put8(b, 0x04);
+    put64(b, 1234);
+
+    for (off = 0, i = 0; off < b->len; off += len, i++) {
+        len = MIN(1000, b->len - off);
+        if (i == 10) {
+            /* the 11th goes after the 12th */
+            add_frame(&flow, 1, seq + off + len, b->data + off + len, MIN(1000, b->len - off - len));
+            add_frame(&flow, 1, seq + off, b->data + off, len);
+            off += len;
+            len = MIN(1000, b->len - off);
+            continue;
+        }
+        add_frame(&flow, 1, seq + off, b->data + off, len);
+        if (i == 50) {
+            add_frame(&flow, 1, seq + off, b->data + off, len);
+        }
+    }
+
+    dissect_flow(&flow);
+    for (line = flow.out->str; *line; line = strchr(line, '\n') + 1) {
+        if (strncmp(line, "Minecraft", 9) == 0) {
+            pdus++;
+        } else if (strncmp(line, "  Skipped:", 10) == 0) {
+            skipped++;
+        }
+    }
+    /* the header, every other segment skipped, then the Keep Alive and Time */
+    if (skipped != flow.num_frames - 1 || pdus != flow.num_frames + 2 ||
+        !strstr(flow.out->str, "Type: 0 (Keep Alive)") || !strstr(flow.out->str, "Type: 4 (")) {
+        fprintf(stderr, "oversized body with retransmissions: %u PDUs, %u skipped in %u frames\n",
+                pdus, skipped, flow.num_frames);
+        failed = 1;
+    }
+
+    g_string_free(flow.out, TRUE);
+    g_free(flow.stream[1].data);
+    g_free(flow.frames);
+    g_free(flow.calls);
+    return failed;
+}
+
+/*
+ * Sampled types are numbered per conversation on the first pass, so in
+ * the second pass every one has to show the next number for its type.
+ */
+static guint check_type_counts(guint index, const GString *out)
+{
+    guint32 last[256];
+    const gchar *line;
+    guint type = 0, count, frame = 0;
+
+    memset(last, 0, sizeof(last));
+    for (line = out->str; *line; line = strchr(line, '\n') + 1) {
+        if (sscanf(line, "Frame %u,", &frame) == 1 || sscanf(line, "  Type: %u (", &type) == 1) {
+            continue;
+        }
+        if (sscanf(line, "  Type Count: %u", &count) == 1) {
+            if (count != last[type & 0xff] + 1) {
+                fprintf(stderr, "session %u frame %u: type 0x%02x numbered %u after %u\n",
+                        index, frame, type, count, last[type & 0xff]);
+                return 1;
+            }
+            last[type & 0xff] = count;
+        }
+    }
+    return 0;
+}
+
+/* Report where two renderings of a session part ways */
+static void report_mismatch(guint index, const GString *a, const GString *b)
+{
+    gsize i, line = 1, start = 0;
+    const gchar *end_a, *end_b;
+
+    for (i = 0; i < a->len && i < b->len && a->str[i] == b->str[i]; i++) {
+        if (a->str[i] == '\n') {
+            line++;
+            start = i + 1;
+        }
+    }
+    end_a = strchr(a->str + start, '\n');
+    end_b = strchr(b->str + start, '\n');
+    fprintf(stderr, "session %u differs at line %lu:\n  serial:   %.*s\n  parallel: %.*s\n",
+            index, (unsigned long)line,
+            end_a ? (int)(end_a - a->str - start) : (int)(a->len - start), a->str + start,
+            end_b ? (int)(end_b - b->str - start) : (int)(b->len - start), b->str + start);
+}
+
+static void set_uint_pref(const char *name, guint value)
+{
+    guint *var = stub_pref(name);
+
+    if (var == NULL) {
+        fprintf(stderr, "no preference %s\n", name);
+        exit(1);
+    }
+    *var = value;
+}
+
+int main(int argc, char **argv)
+{
+    guint num_threads = 8, rounds = 3;
+    GString **serial;
+    pthread_t *threads;
+    guint i, r, failed = 0;
+    gsize bytes = 0;
+
+    if (argc > 1) {
+        num_flows = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        num_threads = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        rounds = atoi(argv[3]);
+    }
+    if (num_flows == 0 || num_threads == 0) {
+        fprintf(stderr, "usage: mc-stress [flows [threads [rounds]]]\n");
+        return 1;
+    }
+
+    proto_register_minecraft();
+    proto_reg_handoff_minecraft();
+
+    /* exercise the per conversation state: sampling and the oversize paths */
+    set_uint_pref("entity_move_detail", 2);
+    set_uint_pref("player_position_detail", 1);
+    set_uint_pref("sample_rate", 7);
+    set_uint_pref("max_map_chunk_len", 64 * 1024);
+    set_uint_pref("reassembly_budget", 96 * 1024);
+
+    flows = g_new0(flow_t, num_flows);
+    for (i = 0; i < num_flows; i++) {
+        build_flow(&flows[i], i);
+    }
+
+    stub_new_capture();
+    failed += check_skipped_body();
+
+    stub_new_capture();
+    serial = g_new0(GString *, num_flows);
+    for (i = 0; i < num_flows; i++) {
+        dissect_flow(&flows[i]);
+        serial[i] = flows[i].out;
+        bytes += serial[i]->len;
+        failed += check_type_counts(i, serial[i]);
+    }
+
+    threads = g_new0(pthread_t, num_threads);
+    for (r = 0; r < rounds; r++) {
+        stub_new_capture();
+        next_flow = 0;
+        for (i = 0; i < num_threads; i++) {
+            pthread_create(&threads[i], NULL, dissect_thread, NULL);
+        }
+        for (i = 0; i < num_threads; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        for (i = 0; i < num_flows; i++) {
+            if (flows[i].out->len != serial[i]->len || memcmp(flows[i].out->str, serial[i]->str, serial[i]->len) != 0) {
+                report_mismatch(i, serial[i], flows[i].out);
+                failed++;
+            }
+            g_string_free(flows[i].out, TRUE);
+        }
+    }
+
+    printf("%u sessions, %lu bytes of tree each pass, %u parallel rounds on %u threads: %s\n",
+           num_flows, (unsigned long)bytes, rounds, num_threads, failed ? "FAILED" : "ok");
+
+    stub_new_capture();
+    for (i = 0; i < num_flows; i++) {
+        g_string_free(serial[i], TRUE);
+        g_free(flows[i].stream[0].data);
+        g_free(flows[i].stream[1].data);
+        g_free(flows[i].frames);
+        g_free(flows[i].calls);
+    }
+    g_free(serial);
+    g_free(threads);
+    g_free(flows);
+    return failed ? 1 : 0;
+}
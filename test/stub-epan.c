@@ -0,0 +1,747 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * Stand-in for the bits of libwireshark the plugin links against, see
+ * stub-epan.h.  Registration happens once before any thread starts, so
+ * only the conversation table and se memory need a lock.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "stub-epan.h"
+
+#define MAX_FIELDS 256
+#define MAX_PREFS  32
+
+struct tvbuff {
+    const guint8 *data;
+    guint length;
+    gint raw_offset;
+    void (*free_cb)(void *);
+    struct tvbuff *next_free;
+};
+
+struct _proto_node {
+    GString *out;
+    int depth;
+};
+
+struct _module {
+    int proto;
+};
+
+struct dissector_handle {
+    dissector_t dissector;
+    int proto;
+};
+
+static header_field_info *fields[MAX_FIELDS];
+static int num_fields;
+static int num_subtrees;
+
+static struct {
+    const char *name;
+    void *var;
+} prefs[MAX_PREFS];
+static int num_prefs;
+static struct _module module;
+
+/* ep memory is per thread; se memory and conversations are shared */
+static __thread void *ep_chunks;
+static __thread tvbuff_t *ep_tvbs;
+static void *se_chunks;
+static GHashTable *conversations;
+static guint32 num_conversations;
+static pthread_mutex_t se_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void stub_fail(const char *what, tvbuff_t *tvb, gint offset, gint length)
+{
+    fprintf(stderr, "stub-epan: %s: offset %d length %d outside tvb of %u bytes\n",
+            what, offset, length, tvb->length);
+    abort();
+}
+
+/* ---- memory ---- */
+
+/* Chunks are chained through a header sized to keep the data aligned */
+#define CHUNK_HEADER 16
+
+static void *chunk_alloc(void **chain, size_t size)
+{
+    void **chunk;
+
+    chunk = malloc(CHUNK_HEADER + size);
+    if (chunk == NULL) {
+        abort();
+    }
+    *chunk = *chain;
+    *chain = chunk;
+    return (guint8 *)chunk + CHUNK_HEADER;
+}
+
+static void chunk_free_all(void **chain)
+{
+    void **chunk, **next;
+
+    for (chunk = *chain; chunk; chunk = next) {
+        next = *chunk;
+        free(chunk);
+    }
+    *chain = NULL;
+}
+
+void *ep_alloc(size_t size)
+{
+    return chunk_alloc(&ep_chunks, size);
+}
+
+void *ep_alloc0(size_t size)
+{
+    return memset(ep_alloc(size), 0, size);
+}
+
+void *se_alloc(size_t size)
+{
+    void *p;
+
+    pthread_mutex_lock(&se_lock);
+    p = chunk_alloc(&se_chunks, size);
+    pthread_mutex_unlock(&se_lock);
+    return p;
+}
+
+void *se_alloc0(size_t size)
+{
+    return memset(se_alloc(size), 0, size);
+}
+
+/* A plain binary tree is plenty for the handful of keys a frame has */
+typedef struct _emem_tree_node {
+    guint32 key;
+    void *data;
+    struct _emem_tree_node *child[2];
+} emem_tree_node_t;
+
+struct _emem_tree_t {
+    emem_tree_node_t *root;
+};
+
+emem_tree_t *se_tree_create_non_persistent(int type _U_, const char *name _U_)
+{
+    return se_alloc0(sizeof(emem_tree_t));
+}
+
+void se_tree_insert32(emem_tree_t *se_tree, guint32 key, void *data)
+{
+    emem_tree_node_t **node = &se_tree->root;
+
+    while (*node && (*node)->key != key) {
+        node = &(*node)->child[key > (*node)->key];
+    }
+    if (*node == NULL) {
+        *node = se_alloc0(sizeof(emem_tree_node_t));
+        (*node)->key = key;
+    }
+    (*node)->data = data;
+}
+
+void *se_tree_lookup32(emem_tree_t *se_tree, guint32 key)
+{
+    emem_tree_node_t *node = se_tree->root;
+
+    while (node && node->key != key) {
+        node = node->child[key > node->key];
+    }
+    return node ? node->data : NULL;
+}
+
+void stub_ep_free_all(void)
+{
+    tvbuff_t *tvb;
+
+    for (tvb = ep_tvbs; tvb; tvb = tvb->next_free) {
+        if (tvb->free_cb) {
+            tvb->free_cb((void *)tvb->data);
+        }
+    }
+    ep_tvbs = NULL;
+    chunk_free_all(&ep_chunks);
+}
+
+void stub_new_capture(void)
+{
+    pthread_mutex_lock(&se_lock);
+    if (conversations) {
+        g_hash_table_destroy(conversations);
+    }
+    conversations = g_hash_table_new(g_direct_hash, g_direct_equal);
+    num_conversations = 0;
+    chunk_free_all(&se_chunks);
+    pthread_mutex_unlock(&se_lock);
+}
+
+/* ---- registration ---- */
+
+static int add_field(header_field_info *hfinfo)
+{
+    if (num_fields == MAX_FIELDS) {
+        fprintf(stderr, "stub-epan: too many fields\n");
+        abort();
+    }
+    hfinfo->id = num_fields;
+    fields[num_fields] = hfinfo;
+    return num_fields++;
+}
+
+int proto_register_protocol(const char *name, const char *short_name _U_, const char *filter_name)
+{
+    header_field_info *hfinfo;
+
+    hfinfo = g_new0(header_field_info, 1);
+    hfinfo->name = name;
+    hfinfo->abbrev = filter_name;
+    hfinfo->type = FT_PROTOCOL;
+    return add_field(hfinfo);
+}
+
+void proto_register_field_array(int parent, hf_register_info *hf, int num_records)
+{
+    int i;
+
+    for (i = 0; i < num_records; i++) {
+        hf[i].hfinfo.parent = parent;
+        *hf[i].p_id = add_field(&hf[i].hfinfo);
+    }
+}
+
+void proto_register_subtree_array(gint *const *indices, int num_indices)
+{
+    int i;
+
+    for (i = 0; i < num_indices; i++) {
+        *indices[i] = num_subtrees++;
+    }
+}
+
+static void add_pref(const char *name, void *var)
+{
+    if (num_prefs == MAX_PREFS) {
+        fprintf(stderr, "stub-epan: too many preferences\n");
+        abort();
+    }
+    prefs[num_prefs].name = name;
+    prefs[num_prefs].var = var;
+    num_prefs++;
+}
+
+module_t *prefs_register_protocol(int id, void (*apply_cb)(void) _U_)
+{
+    module.proto = id;
+    return &module;
+}
+
+void prefs_register_bool_preference(module_t *module _U_, const char *name, const char *title _U_,
+                                    const char *description _U_, gboolean *var)
+{
+    add_pref(name, var);
+}
+
+void prefs_register_uint_preference(module_t *module _U_, const char *name, const char *title _U_,
+                                    const char *description _U_, guint base _U_, guint *var)
+{
+    add_pref(name, var);
+}
+
+void prefs_register_enum_preference(module_t *module _U_, const char *name, const char *title _U_,
+                                    const char *description _U_, gint *var,
+                                    const enum_val_t *enumvals _U_, gboolean radio_buttons _U_)
+{
+    add_pref(name, var);
+}
+
+void *stub_pref(const char *name)
+{
+    int i;
+
+    for (i = 0; i < num_prefs; i++) {
+        if (strcmp(prefs[i].name, name) == 0) {
+            return prefs[i].var;
+        }
+    }
+    return NULL;
+}
+
+dissector_handle_t create_dissector_handle(dissector_t dissector, int proto)
+{
+    dissector_handle_t handle;
+
+    handle = g_new0(struct dissector_handle, 1);
+    handle->dissector = dissector;
+    handle->proto = proto;
+    return handle;
+}
+
+void dissector_add(const char *name _U_, guint32 pattern _U_, dissector_handle_t handle _U_)
+{
+}
+
+/* ---- tvbs ---- */
+
+tvbuff_t *stub_tvb_new(const guint8 *data, guint length, gint raw_offset)
+{
+    tvbuff_t *tvb;
+
+    tvb = ep_alloc0(sizeof(tvbuff_t));
+    tvb->data = data;
+    tvb->length = length;
+    tvb->raw_offset = raw_offset;
+    return tvb;
+}
+
+static const guint8 *get_bytes(tvbuff_t *tvb, gint offset, gint length, const char *what)
+{
+    if (offset < 0 || length < 0 || (guint)offset > tvb->length || (guint)length > tvb->length - offset) {
+        stub_fail(what, tvb, offset, length);
+    }
+    return tvb->data + offset;
+}
+
+guint8 tvb_get_guint8(tvbuff_t *tvb, gint offset)
+{
+    return *get_bytes(tvb, offset, 1, "tvb_get_guint8");
+}
+
+guint16 tvb_get_ntohs(tvbuff_t *tvb, gint offset)
+{
+    const guint8 *p = get_bytes(tvb, offset, 2, "tvb_get_ntohs");
+
+    return p[0] << 8 | p[1];
+}
+
+guint32 tvb_get_ntohl(tvbuff_t *tvb, gint offset)
+{
+    const guint8 *p = get_bytes(tvb, offset, 4, "tvb_get_ntohl");
+
+    return (guint32)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+guint64 tvb_get_ntoh64(tvbuff_t *tvb, gint offset)
+{
+    return (guint64)tvb_get_ntohl(tvb, offset) << 32 | tvb_get_ntohl(tvb, offset + 4);
+}
+
+gdouble tvb_get_ntohieee_double(tvbuff_t *tvb, gint offset)
+{
+    guint64 bits = tvb_get_ntoh64(tvb, offset);
+    gdouble v;
+
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static gfloat get_ntohieee_float(tvbuff_t *tvb, gint offset)
+{
+    guint32 bits = tvb_get_ntohl(tvb, offset);
+    gfloat v;
+
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+const guint8 *tvb_get_ptr(tvbuff_t *tvb, gint offset, gint length)
+{
+    if (length == -1) {
+        length = tvb_reported_length_remaining(tvb, offset);
+    }
+    return get_bytes(tvb, offset, length, "tvb_get_ptr");
+}
+
+guint8 *tvb_get_ephemeral_string(tvbuff_t *tvb, gint offset, gint length)
+{
+    guint8 *s;
+
+    s = ep_alloc(length + 1);
+    memcpy(s, get_bytes(tvb, offset, length, "tvb_get_ephemeral_string"), length);
+    s[length] = '\0';
+    return s;
+}
+
+guint tvb_length(tvbuff_t *tvb)
+{
+    return tvb->length;
+}
+
+guint tvb_reported_length(tvbuff_t *tvb)
+{
+    return tvb->length;
+}
+
+gint tvb_reported_length_remaining(tvbuff_t *tvb, gint offset)
+{
+    if (offset < 0 || (guint)offset > tvb->length) {
+        return -1;
+    }
+    return tvb->length - offset;
+}
+
+gboolean tvb_bytes_exist(tvbuff_t *tvb, gint offset, gint length)
+{
+    return offset >= 0 && length >= 0 && (guint)offset <= tvb->length &&
+           (guint)length <= tvb->length - offset;
+}
+
+gint tvb_raw_offset(tvbuff_t *tvb)
+{
+    return tvb->raw_offset;
+}
+
+tvbuff_t *tvb_new_child_real_data(tvbuff_t *parent _U_, const guint8 *data, guint length, gint reported_length _U_)
+{
+    tvbuff_t *tvb;
+
+    tvb = stub_tvb_new(data, length, 0);
+    tvb->next_free = ep_tvbs;
+    ep_tvbs = tvb;
+    return tvb;
+}
+
+void tvb_set_free_cb(tvbuff_t *tvb, void (*func)(void *))
+{
+    tvb->free_cb = func;
+}
+
+void add_new_data_source(packet_info *pinfo _U_, tvbuff_t *tvb _U_, const char *name _U_)
+{
+}
+
+/* ---- proto tree ---- */
+
+proto_tree *stub_tree_new(GString *out)
+{
+    proto_tree *tree;
+
+    tree = ep_alloc0(sizeof(proto_tree));
+    tree->out = out;
+    return tree;
+}
+
+static proto_item *add_line(proto_tree *tree, const char *text)
+{
+    proto_item *item;
+
+    g_string_append_printf(tree->out, "%*s%s\n", tree->depth * 2, "", text);
+    item = ep_alloc0(sizeof(proto_item));
+    item->out = tree->out;
+    item->depth = tree->depth;
+    return item;
+}
+
+/* FNV-1a, so big byte fields can be compared without printing them */
+static guint32 hash_bytes(const guint8 *p, gint length)
+{
+    guint32 h = 2166136261U;
+
+    while (length-- > 0) {
+        h = (h ^ *p++) * 16777619U;
+    }
+    return h;
+}
+
+static void format_string(GString *s, const guint8 *p, gint length)
+{
+    gint i;
+
+    for (i = 0; i < length; i++) {
+        if (p[i] >= 0x20 && p[i] < 0x7f && p[i] != '\\') {
+            g_string_append_printf(s, "%c", p[i]);
+        } else {
+            g_string_append_printf(s, "\\x%02x", p[i]);
+        }
+    }
+}
+
+proto_item *proto_tree_add_item(proto_tree *tree, int hfindex, tvbuff_t *tvb, gint start, gint length,
+                                gboolean little_endian _U_)
+{
+    header_field_info *hfinfo;
+    const guint8 *p;
+    guint64 v = 0;
+    proto_item *item;
+    GString *s;
+    gint i;
+
+    if (tree == NULL) {
+        return NULL;
+    }
+    if (length == -1) {
+        length = tvb_reported_length_remaining(tvb, start);
+    }
+    p = get_bytes(tvb, start, length, "proto_tree_add_item");
+    hfinfo = fields[hfindex];
+
+    s = g_string_new("");
+    g_string_append_printf(s, "%s", hfinfo->name);
+    switch (hfinfo->type) {
+    case FT_UINT8: case FT_UINT16: case FT_UINT24: case FT_UINT32: case FT_UINT64:
+    case FT_INT8: case FT_INT16: case FT_INT24: case FT_INT32: case FT_INT64:
+    case FT_BOOLEAN:
+        for (i = 0; i < length; i++) {
+            v = v << 8 | p[i];
+        }
+        if (hfinfo->type >= FT_INT8 && hfinfo->type <= FT_INT64 && length < 8 && length > 0 &&
+            (v >> (length * 8 - 1)) & 1) {
+            v |= ~G_GUINT64_CONSTANT(0) << (length * 8);
+        }
+        if (hfinfo->type >= FT_INT8 && hfinfo->type <= FT_INT64) {
+            g_string_append_printf(s, ": %" G_GINT64_MODIFIER "d", (gint64)v);
+        } else {
+            g_string_append_printf(s, ": %" G_GINT64_MODIFIER "u", v);
+        }
+        if (hfinfo->strings) {
+            g_string_append_printf(s, " (%s)", val_to_str((guint32)v, hfinfo->strings, "Unknown"));
+        }
+        break;
+    case FT_FLOAT:
+        g_string_append_printf(s, ": %.9g", get_ntohieee_float(tvb, start));
+        break;
+    case FT_DOUBLE:
+        g_string_append_printf(s, ": %.17g", tvb_get_ntohieee_double(tvb, start));
+        break;
+    case FT_STRING: case FT_STRINGZ: case FT_UINT_STRING:
+        g_string_append_printf(s, ": \"");
+        format_string(s, p, length);
+        g_string_append_printf(s, "\"");
+        break;
+    case FT_BYTES:
+        g_string_append_printf(s, ": %d bytes, hash %08x", length, hash_bytes(p, length));
+        break;
+    default:
+        break;
+    }
+    g_string_append_printf(s, " [%d+%d]", start, length);
+
+    item = add_line(tree, s->str);
+    g_string_free(s, TRUE);
+    return item;
+}
+
+proto_item *proto_tree_add_uint(proto_tree *tree, int hfindex, tvbuff_t *tvb, gint start, gint length, guint32 value)
+{
+    proto_item *item;
+    gchar *line;
+
+    if (tree == NULL) {
+        return NULL;
+    }
+    get_bytes(tvb, start, length, "proto_tree_add_uint");
+    line = g_strdup_printf("%s: %u [%d+%d]", fields[hfindex]->name, value, start, length);
+    item = add_line(tree, line);
+    g_free(line);
+    return item;
+}
+
+proto_item *proto_tree_add_text(proto_tree *tree, tvbuff_t *tvb _U_, gint start, gint length, const char *format, ...)
+{
+    proto_item *item;
+    GString *s;
+    va_list ap;
+
+    if (tree == NULL) {
+        return NULL;
+    }
+    s = g_string_new("");
+    va_start(ap, format);
+    g_string_append_vprintf(s, format, ap);
+    va_end(ap);
+    g_string_append_printf(s, " [%d+%d]", start, length);
+    item = add_line(tree, s->str);
+    g_string_free(s, TRUE);
+    return item;
+}
+
+proto_tree *proto_item_add_subtree(proto_item *item, gint idx _U_)
+{
+    proto_tree *tree;
+
+    if (item == NULL) {
+        return NULL;
+    }
+    tree = ep_alloc0(sizeof(proto_tree));
+    tree->out = item->out;
+    tree->depth = item->depth + 1;
+    return tree;
+}
+
+/* Appended text goes on a line of its own, the output is only ever compared */
+void proto_item_append_text(proto_item *item, const char *format, ...)
+{
+    va_list ap;
+
+    if (item == NULL) {
+        return;
+    }
+    g_string_append_printf(item->out, "%*s+ ", item->depth * 2, "");
+    va_start(ap, format);
+    g_string_append_vprintf(item->out, format, ap);
+    va_end(ap);
+    g_string_append_printf(item->out, "\n");
+}
+
+void proto_item_set_end(proto_item *item _U_, tvbuff_t *tvb _U_, gint end _U_)
+{
+}
+
+gboolean proto_field_is_referenced(proto_tree *tree, int proto_id _U_)
+{
+    return tree != NULL;
+}
+
+gboolean check_col(column_info *cinfo, gint col _U_)
+{
+    return cinfo != NULL;
+}
+
+void col_set_str(column_info *cinfo _U_, gint col _U_, const gchar *str _U_)
+{
+}
+
+void col_add_fstr(column_info *cinfo _U_, gint col _U_, const gchar *format _U_, ...)
+{
+}
+
+const gchar *val_to_str(guint32 val, const value_string *vs, const char *fmt)
+{
+    gchar *s;
+
+    for (; vs && vs->strptr; vs++) {
+        if (vs->value == val) {
+            return vs->strptr;
+        }
+    }
+    s = ep_alloc(64);
+    g_snprintf(s, 64, fmt, val);
+    return s;
+}
+
+void expert_add_info_format(packet_info *pinfo _U_, proto_item *pi, int group _U_, int severity _U_,
+                            const char *format, ...)
+{
+    va_list ap;
+
+    if (pi == NULL) {
+        return;
+    }
+    g_string_append_printf(pi->out, "%*s[Expert: ", (pi->depth + 1) * 2, "");
+    va_start(ap, format);
+    g_string_append_vprintf(pi->out, format, ap);
+    va_end(ap);
+    g_string_append_printf(pi->out, "]\n");
+}
+
+/* ---- conversations and per frame data ---- */
+
+conversation_t *find_or_create_conversation(packet_info *pinfo)
+{
+    conversation_t *conv;
+    guint32 lo, hi;
+    gpointer key;
+
+    lo = MIN(pinfo->srcport, pinfo->destport);
+    hi = MAX(pinfo->srcport, pinfo->destport);
+    key = GUINT_TO_POINTER(lo << 16 | hi);
+
+    pthread_mutex_lock(&se_lock);
+    conv = g_hash_table_lookup(conversations, key);
+    if (conv == NULL) {
+        conv = (conversation_t *)chunk_alloc(&se_chunks, sizeof(conversation_t));
+        memset(conv, 0, sizeof(*conv));
+        conv->index = num_conversations++;
+        conv->port1 = lo;
+        conv->port2 = hi;
+        g_hash_table_insert(conversations, key, conv);
+    }
+    pthread_mutex_unlock(&se_lock);
+    return conv;
+}
+
+/* Conversations are told apart by their ports alone */
+conversation_t *find_conversation(guint32 frame_num _U_, const address *addr_a _U_, const address *addr_b _U_,
+                                  port_type ptype _U_, guint32 port_a, guint32 port_b, guint options _U_)
+{
+    conversation_t *conv;
+    guint32 lo, hi;
+
+    lo = MIN(port_a, port_b);
+    hi = MAX(port_a, port_b);
+    pthread_mutex_lock(&se_lock);
+    conv = g_hash_table_lookup(conversations, GUINT_TO_POINTER(lo << 16 | hi));
+    pthread_mutex_unlock(&se_lock);
+    return conv;
+}
+
+void conversation_add_proto_data(conversation_t *conv, int proto _U_, void *proto_data)
+{
+    conv->proto_data = proto_data;
+}
+
+void *conversation_get_proto_data(conversation_t *conv, int proto _U_)
+{
+    return conv->proto_data;
+}
+
+void p_add_proto_data(frame_data *fd, int proto _U_, void *proto_data)
+{
+    fd->proto_data = proto_data;
+}
+
+void *p_get_proto_data(frame_data *fd, int proto _U_)
+{
+    return fd->proto_data;
+}
+
+/* ---- taps, nothing is ever listening ---- */
+
+int register_tap(const char *name _U_)
+{
+    return 1;
+}
+
+gboolean have_tap_listener(int tap_id _U_)
+{
+    return FALSE;
+}
+
+void tap_queue_packet(int tap_id _U_, packet_info *pinfo _U_, const void *tap_specific_data _U_)
+{
+}
+
+GString *register_tap_listener(const char *tapname _U_, void *tapdata _U_, const char *fstring _U_, guint flags _U_,
+                               tap_reset_cb reset _U_, tap_packet_cb packet _U_, tap_draw_cb draw _U_)
+{
+    return NULL;
+}
+
+void register_stat_cmd_arg(const char *cmd _U_, void (*func)(const char *arg, void *userdata) _U_, void *userdata _U_)
+{
+}
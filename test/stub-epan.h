@@ -0,0 +1,276 @@
+/* Copyright (C) 2011 by Scott Brooks
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/*
+ * The part of the Wireshark 1.x epan API the plugin uses, implemented in
+ * stub-epan.c so the dissector can be driven from a test program.  The
+ * epan/ headers next to this file all just include it.
+ *
+ * libwireshark itself can't dissect from several threads (its ep/se
+ * allocators and conversation table are global), so this is also the
+ * only way to check that nothing in the plugin gets in the way of it.
+ * Allocations are per thread and the conversation table is locked; the
+ * proto tree is rendered as text into a buffer owned by its root.
+ */
+
+#ifndef __STUB_EPAN_H__
+#define __STUB_EPAN_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+/* ---- registration ---- */
+
+enum ftenum {
+    FT_NONE, FT_PROTOCOL, FT_BOOLEAN,
+    FT_UINT8, FT_UINT16, FT_UINT24, FT_UINT32, FT_UINT64,
+    FT_INT8, FT_INT16, FT_INT24, FT_INT32, FT_INT64,
+    FT_FLOAT, FT_DOUBLE, FT_STRING, FT_STRINGZ, FT_UINT_STRING, FT_BYTES
+};
+
+enum { BASE_NONE, BASE_DEC, BASE_HEX, BASE_OCT, BASE_DEC_HEX, BASE_HEX_DEC };
+
+typedef struct _value_string {
+    guint32 value;
+    const gchar *strptr;
+} value_string;
+
+#define VALS(x) ((const struct _value_string *)(x))
+
+typedef struct _header_field_info {
+    const char *name;
+    const char *abbrev;
+    enum ftenum type;
+    int display;
+    const void *strings;
+    guint32 bitmask;
+    const char *blurb;
+    int id;
+    int parent;
+} header_field_info;
+
+#define HFILL -1, 0
+
+typedef struct _hf_register_info {
+    int *p_id;
+    header_field_info hfinfo;
+} hf_register_info;
+
+typedef struct _enum_val_t {
+    const char *name;
+    const char *description;
+    gint value;
+} enum_val_t;
+
+#define array_length(x) (sizeof x / sizeof x[0])
+
+typedef struct _module module_t;
+
+int proto_register_protocol(const char *name, const char *short_name, const char *filter_name);
+void proto_register_field_array(int parent, hf_register_info *hf, int num_records);
+void proto_register_subtree_array(gint *const *indices, int num_indices);
+
+module_t *prefs_register_protocol(int id, void (*apply_cb)(void));
+void prefs_register_bool_preference(module_t *module, const char *name, const char *title,
+                                    const char *description, gboolean *var);
+void prefs_register_uint_preference(module_t *module, const char *name, const char *title,
+                                    const char *description, guint base, guint *var);
+void prefs_register_enum_preference(module_t *module, const char *name, const char *title,
+                                    const char *description, gint *var,
+                                    const enum_val_t *enumvals, gboolean radio_buttons);
+
+/* ---- packets ---- */
+
+typedef struct _nstime_t {
+    time_t secs;
+    int nsecs;
+} nstime_t;
+
+typedef struct _frame_data {
+    guint32 num;
+    struct {
+        unsigned int visited : 1;
+    } flags;
+    nstime_t abs_ts;
+    void *proto_data;
+} frame_data;
+
+typedef struct _address {
+    int type;
+    int len;
+    const void *data;
+} address;
+
+typedef enum { PT_NONE, PT_SCTP, PT_TCP, PT_UDP } port_type;
+
+typedef struct _column_info column_info;
+
+enum { COL_PROTOCOL, COL_INFO };
+
+typedef struct _packet_info {
+    frame_data *fd;
+    column_info *cinfo;
+    guint32 srcport;
+    guint32 destport;
+    guint32 match_port;
+    int desegment_offset;
+    guint32 desegment_len;
+    void *private_data;
+} packet_info;
+
+#define DESEGMENT_ONE_MORE_SEGMENT 0x0fffffff
+
+typedef struct tvbuff tvbuff_t;
+typedef struct _proto_node proto_node;
+typedef proto_node proto_tree;
+typedef proto_node proto_item;
+typedef struct epan_dissect epan_dissect_t;
+
+typedef void (*dissector_t)(tvbuff_t *, packet_info *, proto_tree *);
+typedef struct dissector_handle *dissector_handle_t;
+
+dissector_handle_t create_dissector_handle(dissector_t dissector, int proto);
+void dissector_add(const char *name, guint32 pattern, dissector_handle_t handle);
+
+guint8 tvb_get_guint8(tvbuff_t *tvb, gint offset);
+guint16 tvb_get_ntohs(tvbuff_t *tvb, gint offset);
+guint32 tvb_get_ntohl(tvbuff_t *tvb, gint offset);
+guint64 tvb_get_ntoh64(tvbuff_t *tvb, gint offset);
+gdouble tvb_get_ntohieee_double(tvbuff_t *tvb, gint offset);
+const guint8 *tvb_get_ptr(tvbuff_t *tvb, gint offset, gint length);
+guint8 *tvb_get_ephemeral_string(tvbuff_t *tvb, gint offset, gint length);
+guint tvb_length(tvbuff_t *tvb);
+guint tvb_reported_length(tvbuff_t *tvb);
+gint tvb_reported_length_remaining(tvbuff_t *tvb, gint offset);
+gboolean tvb_bytes_exist(tvbuff_t *tvb, gint offset, gint length);
+gint tvb_raw_offset(tvbuff_t *tvb);
+tvbuff_t *tvb_new_child_real_data(tvbuff_t *parent, const guint8 *data, guint length, gint reported_length);
+void tvb_set_free_cb(tvbuff_t *tvb, void (*func)(void *));
+void add_new_data_source(packet_info *pinfo, tvbuff_t *tvb, const char *name);
+
+proto_item *proto_tree_add_item(proto_tree *tree, int hfindex, tvbuff_t *tvb, gint start, gint length, gboolean little_endian);
+proto_item *proto_tree_add_uint(proto_tree *tree, int hfindex, tvbuff_t *tvb, gint start, gint length, guint32 value);
+proto_item *proto_tree_add_text(proto_tree *tree, tvbuff_t *tvb, gint start, gint length, const char *format, ...);
+proto_tree *proto_item_add_subtree(proto_item *item, gint idx);
+void proto_item_append_text(proto_item *item, const char *format, ...);
+void proto_item_set_end(proto_item *item, tvbuff_t *tvb, gint end);
+gboolean proto_field_is_referenced(proto_tree *tree, int proto_id);
+
+#define PROTO_ITEM_SET_GENERATED(item) ((void)(item))
+
+gboolean check_col(column_info *cinfo, gint col);
+void col_set_str(column_info *cinfo, gint col, const gchar *str);
+void col_add_fstr(column_info *cinfo, gint col, const gchar *format, ...);
+
+const gchar *val_to_str(guint32 val, const value_string *vs, const char *fmt);
+
+/* ---- expert info ---- */
+
+#define PI_MALFORMED 0x07000000
+#define PI_WARN      0x00600000
+
+void expert_add_info_format(packet_info *pinfo, proto_item *pi, int group, int severity, const char *format, ...);
+
+/* ---- conversations and per frame data ---- */
+
+typedef struct conversation {
+    guint32 index;
+    guint32 port1;
+    guint32 port2;
+    void *proto_data;
+} conversation_t;
+
+conversation_t *find_or_create_conversation(packet_info *pinfo);
+conversation_t *find_conversation(guint32 frame_num, const address *addr_a, const address *addr_b,
+                                  port_type ptype, guint32 port_a, guint32 port_b, guint options);
+void conversation_add_proto_data(conversation_t *conv, int proto, void *proto_data);
+void *conversation_get_proto_data(conversation_t *conv, int proto);
+
+void p_add_proto_data(frame_data *fd, int proto, void *proto_data);
+void *p_get_proto_data(frame_data *fd, int proto);
+
+typedef struct _emem_tree_t emem_tree_t;
+
+#define EMEM_TREE_TYPE_RED_BLACK 1
+
+emem_tree_t *se_tree_create_non_persistent(int type, const char *name);
+void se_tree_insert32(emem_tree_t *se_tree, guint32 key, void *data);
+void *se_tree_lookup32(emem_tree_t *se_tree, guint32 key);
+
+void *ep_alloc(size_t size);
+void *ep_alloc0(size_t size);
+void *se_alloc(size_t size);
+void *se_alloc0(size_t size);
+
+/* ---- taps ---- */
+
+typedef void (*tap_reset_cb)(void *tapdata);
+typedef int (*tap_packet_cb)(void *tapdata, packet_info *pinfo, epan_dissect_t *edt, const void *data);
+typedef void (*tap_draw_cb)(void *tapdata);
+
+int register_tap(const char *name);
+gboolean have_tap_listener(int tap_id);
+void tap_queue_packet(int tap_id, packet_info *pinfo, const void *tap_specific_data);
+GString *register_tap_listener(const char *tapname, void *tapdata, const char *fstring, guint flags,
+                               tap_reset_cb reset, tap_packet_cb packet, tap_draw_cb draw);
+void register_stat_cmd_arg(const char *cmd, void (*func)(const char *arg, void *userdata), void *userdata);
+
+/* What the TCP dissector queues to the "tcp" tap */
+struct tcpheader {
+    guint32 th_seq;
+    guint32 th_ack;
+    gboolean th_have_seglen;
+    guint32 th_seglen;
+    guint32 th_win;
+    guint16 th_sport;
+    guint16 th_dport;
+    guint8 th_hlen;
+    guint8 th_flags;
+    address ip_src;
+    address ip_dst;
+};
+
+/* ---- test side ---- */
+
+/* What the TCP dissector passes in pinfo->private_data */
+struct tcpinfo {
+    guint32 seq;
+    guint32 nxtseq;
+    gboolean is_reassembled;
+};
+
+/* A tvb over data (which the caller keeps), freed with the ep memory */
+tvbuff_t *stub_tvb_new(const guint8 *data, guint length, gint raw_offset);
+
+/* Root of a tree rendered into out */
+proto_tree *stub_tree_new(GString *out);
+
+/* Where a preference registered under name lives, NULL if unknown */
+void *stub_pref(const char *name);
+
+/* Free this thread's ep memory, as epan does after every packet */
+void stub_ep_free_all(void);
+
+/* Forget all conversations and se memory, as epan does between captures */
+void stub_new_capture(void);
+
+#endif